@@ -30,6 +30,7 @@ public class CSVDataReader : ModuleRules
                 "Engine",
                 "Slate",
                 "SlateCore",
+				"UE4_nlopt",
 				// ... add other public dependencies that you statically link with here ...
 			}
             );
@@ -41,6 +42,9 @@ public class CSVDataReader : ModuleRules
 				// ... add private dependencies that you statically link with here ...	
 			}
 			);
+
+		// Compressed study data
+		AddEngineThirdPartyPrivateStaticDependencies(Target, "zlib");
 		
 		
 		DynamicallyLoadedModuleNames.AddRange(
@@ -1,12 +1,14 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "CSVDataReader.h"
+#include "ReplayBenchmark.h"
 
 #define LOCTEXT_NAMESPACE "FCSVDataReaderModule"
 
 void FCSVDataReaderModule::StartupModule()
 {
 	// This code will execute after your module is loaded into memory; the exact timing is specified in the .uplugin file per-module
+	InstallAllocationCounter();
 }
 
 void FCSVDataReaderModule::ShutdownModule()
@@ -0,0 +1,267 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ParticipantArchive.h"
+#include "HAL/PlatformFilemanager.h"
+
+THIRD_PARTY_INCLUDES_START
+#include "zlib.h"
+THIRD_PARTY_INCLUDES_END
+
+namespace
+{
+	const uint8 GZIP_MAGIC[2] = { 0x1f, 0x8b };
+	const int32 TAR_BLOCK = 512;
+
+	bool is_gzip(const uint8* bytes, int32 num)
+	{
+		return num >= 2 && bytes[0] == GZIP_MAGIC[0] && bytes[1] == GZIP_MAGIC[1];
+	}
+
+	// Octal number field of a tar header
+	int64 tar_number(const uint8* field, int32 width)
+	{
+		int64 value = 0;
+		for (int32 i = 0; i < width && field[i]; i++)
+		{
+			if (field[i] < '0' || field[i] > '7') continue;
+			value = value * 8 + (field[i] - '0');
+		}
+		return value;
+	}
+
+	FString tar_string(const uint8* field, int32 width)
+	{
+		ANSICHAR text[256];
+		int32 n = 0;
+		while (n < width && field[n]) n++;
+		FMemory::Memcpy(text, field, n);
+		text[n] = 0;
+		return FString(ANSI_TO_TCHAR(text));
+	}
+}
+
+participant_file_stream::participant_file_stream()
+	: _remaining(0), _z(nullptr), _in_pos(0), _member_done(false), _failed(false)
+{
+}
+
+participant_file_stream::~participant_file_stream()
+{
+	Close();
+}
+
+bool participant_file_stream::Open(const FString& filepath)
+{
+	Close();
+	_file.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*filepath));
+	if (!_file) return false;
+	_remaining = _file->Size();
+	Refill();
+
+	if (is_gzip(_in.GetData(), _in.Num()))
+	{
+		_z = new z_stream_s();
+		FMemory::Memzero(_z, sizeof(z_stream_s));
+		// 15 window bits, +32 to accept a gzip (or zlib) header
+		if (inflateInit2(_z, 15 + 32) != Z_OK)
+		{
+			Close();
+			return false;
+		}
+		_z->next_in = _in.GetData();
+		_z->avail_in = _in.Num();
+	}
+	return true;
+}
+
+void participant_file_stream::Close()
+{
+	if (_z)
+	{
+		inflateEnd(_z);
+		delete _z;
+		_z = nullptr;
+	}
+	_file.Reset();
+	_in.Reset();
+	_in_pos = 0;
+	_remaining = 0;
+	_member_done = false;
+	_failed = false;
+}
+
+bool participant_file_stream::Refill()
+{
+	if (!_file || _remaining <= 0) return false;
+	const int32 num = static_cast<int32>(FMath::Min<int64>(CHUNK_BYTES, _remaining));
+	_in.SetNumUninitialized(num, false);
+	if (!_file->Read(_in.GetData(), num))
+	{
+		_remaining = 0;
+		return false;
+	}
+	_remaining -= num;
+	_in_pos = 0;
+	return true;
+}
+
+int32 participant_file_stream::Read(uint8* out, int32 num)
+{
+	if (!_file || num <= 0) return 0;
+
+	if (!_z)
+	{
+		if (_in_pos == _in.Num() && !Refill()) return 0;
+		const int32 n = FMath::Min(num, _in.Num() - _in_pos);
+		FMemory::Memcpy(out, _in.GetData() + _in_pos, n);
+		_in_pos += n;
+		return n;
+	}
+
+	_z->next_out = out;
+	_z->avail_out = num;
+	while (_z->avail_out == static_cast<uInt>(num) && !_member_done)
+	{
+		if (_z->avail_in == 0)
+		{
+			// The file ended inside a member, it was cut short
+			if (!Refill())
+			{
+				_failed = true;
+				return -1;
+			}
+			_z->next_in = _in.GetData();
+			_z->avail_in = _in.Num();
+		}
+
+		const int ret = inflate(_z, Z_NO_FLUSH);
+		if (ret == Z_STREAM_END)
+		{
+			// Another gzip member may follow, anything else (e.g. padding) ends the stream
+			if (_z->avail_in == 0 && Refill())
+			{
+				_z->next_in = _in.GetData();
+				_z->avail_in = _in.Num();
+			}
+			if (_z->avail_in > 0 && _z->next_in[0] == GZIP_MAGIC[0])
+			{
+				inflateReset(_z);
+			}
+			else
+			{
+				_member_done = true;
+			}
+		}
+		else if (ret != Z_OK && ret != Z_BUF_ERROR)
+		{
+			_failed = true;
+			return -1;
+		}
+	}
+	return num - static_cast<int32>(_z->avail_out);
+}
+
+bool participant_file_stream::ReadExact(uint8* out, int32 num)
+{
+	while (num > 0)
+	{
+		const int32 n = Read(out, num);
+		if (n <= 0) return false;
+		out += n;
+		num -= n;
+	}
+	return true;
+}
+
+bool participant_file_stream::Skip(int64 num)
+{
+	uint8 scratch[4096];
+	while (num > 0)
+	{
+		const int32 n = Read(scratch, static_cast<int32>(FMath::Min<int64>(num, sizeof(scratch))));
+		if (n <= 0) return false;
+		num -= n;
+	}
+	return true;
+}
+
+bool ParseParticipantStream(participant_file_stream& stream, int64 num_bytes, participant_columns& columns)
+{
+	participant_tail_parser parser;
+	TArray<uint8> buffer;
+	buffer.SetNumUninitialized(participant_file_stream::CHUNK_BYTES);
+
+	int64 left = num_bytes;
+	while (num_bytes < 0 || left > 0)
+	{
+		const int32 want = num_bytes < 0 ? buffer.Num() : static_cast<int32>(FMath::Min<int64>(buffer.Num(), left));
+		const int32 n = stream.Read(buffer.GetData(), want);
+		if (n < 0) return false;
+		if (n == 0)
+		{
+			if (num_bytes >= 0) return false;
+			break;
+		}
+		parser.Feed(reinterpret_cast<const ANSICHAR*>(buffer.GetData()), n, columns);
+		left -= n;
+	}
+	parser.Finish(columns);
+	return true;
+}
+
+int32 ForEachArchivedParticipant(const FString& archive_path,
+	const std::function<void(const FString& path, participant_columns_ptr columns)>& on_file)
+{
+	participant_file_stream stream;
+	if (!stream.Open(archive_path)) return -1;
+
+	int32 num_files = 0;
+	FString long_name;
+	uint8 header[TAR_BLOCK];
+	while (stream.ReadExact(header, TAR_BLOCK))
+	{
+		// Two zero blocks end the archive, one is enough to stop
+		bool zero = true;
+		for (int32 i = 0; i < TAR_BLOCK && zero; i++) zero = header[i] == 0;
+		if (zero) break;
+
+		const int64 size = tar_number(header + 124, 12);
+		const int64 padding = (TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK;
+		const uint8 type = header[156];
+
+		FString name = tar_string(header, 100);
+		if (FMemory::Memcmp(header + 257, "ustar", 5) == 0 && header[345])
+		{
+			name = tar_string(header + 345, 155) / name;
+		}
+		if (!long_name.IsEmpty())
+		{
+			name = long_name;
+			long_name.Reset();
+		}
+
+		// GNU long name, the name of the next entry
+		if (type == 'L')
+		{
+			TArray<uint8> text;
+			text.SetNumZeroed(static_cast<int32>(size) + 1);
+			if (!stream.ReadExact(text.GetData(), static_cast<int32>(size)) || !stream.Skip(padding)) return -1;
+			long_name = FString(ANSI_TO_TCHAR(reinterpret_cast<const ANSICHAR*>(text.GetData())));
+			continue;
+		}
+
+		const bool regular = type == '0' || type == 0;
+		if (regular && name.EndsWith(TEXT("Data.csv")))
+		{
+			TSharedRef<participant_columns, ESPMode::ThreadSafe> columns = MakeShared<participant_columns, ESPMode::ThreadSafe>();
+			if (!ParseParticipantStream(stream, size, *columns) || !stream.Skip(padding)) return -1;
+			on_file(name, columns);
+			num_files++;
+			continue;
+		}
+
+		if (!stream.Skip(size + padding)) return -1;
+	}
+	return stream.HasFailed() ? -1 : num_files;
+}
@@ -0,0 +1,204 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ParticipantColumns.h"
+#include "ParticipantArchive.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/ScopeLock.h"
+
+namespace
+{
+	// Column indices in Data.csv
+	const int COL_HOUSE = 0;
+	const int COL_HEALTH = 7;
+	const int COL_TIME = 9;
+	const int COL_RECOMMENDATION = 11;
+	const int COL_ACTION = 15;
+	const int COL_TRUST_FEEDBACK = 12;
+	const int COL_ORIGINAL_ESTIMATE = 13;
+	const int COL_PERFORMANCE = 14;
+	const int COL_THREAT = 16;
+	const int NUM_COLS = 17;
+
+	// Size and modification time of a file, an entry is only shared while
+	// both still match
+	struct file_version
+	{
+		int64 size = -1;
+		FDateTime timestamp;
+
+		static file_version Of(const FString& filepath)
+		{
+			file_version version;
+			version.size = IFileManager::Get().FileSize(*filepath);
+			version.timestamp = IFileManager::Get().GetTimeStamp(*filepath);
+			return version;
+		}
+		bool operator==(const file_version& other) const { return size == other.size && timestamp == other.timestamp; }
+	};
+
+	struct registry_entry
+	{
+		TWeakPtr<const participant_columns, ESPMode::ThreadSafe> columns;
+		file_version version;
+	};
+
+	// Loaded files, by path. Weak, so unused columns are freed.
+	FCriticalSection registry_lock;
+	TMap<FString, registry_entry> registry;
+}
+
+SIZE_T participant_columns::GetAllocatedSize() const
+{
+	return house_numbers.GetAllocatedSize() + health_points.GetAllocatedSize() + time_points.GetAllocatedSize()
+		+ recommendations.GetAllocatedSize() + actions.GetAllocatedSize() + trust_feedback.GetAllocatedSize() + original_estimates.GetAllocatedSize()
+		+ performance_history.GetAllocatedSize() + threat_levels.GetAllocatedSize();
+}
+
+void participant_columns::Parse(const FString& text)
+{
+	const TCHAR* p = *text;
+
+	// Size the columns once
+	int num_lines = 0;
+	for (const TCHAR* c = p; *c; c++)
+	{
+		if (*c == TEXT('\n')) num_lines++;
+	}
+	for (TArray<int>* column : { &house_numbers, &health_points, &time_points, &recommendations, &actions, &trust_feedback,
+								 &performance_history })
+	{
+		column->Reset(num_lines);
+	}
+	original_estimates.Reset(num_lines);
+	threat_levels.Reset(num_lines);
+
+	// Skip the header
+	while (*p && *p != TEXT('\n')) p++;
+
+	while (*p)
+	{
+		const TCHAR* end = p;
+		while (*end && *end != TEXT('\n')) end++;
+		AddLine(p, end);
+		p = *end ? end + 1 : end;
+	}
+}
+
+template <typename CharType>
+bool participant_columns::AddLine(const CharType* begin, const CharType* end)
+{
+	// Read the fields in place, Atoi / Atof stop at the comma
+	const CharType* fields[NUM_COLS];
+	int num_fields = 0;
+	fields[num_fields++] = begin;
+	for (const CharType* p = begin; p < end && num_fields < NUM_COLS; p++)
+	{
+		if (*p == ',') fields[num_fields++] = p + 1;
+	}
+	if (num_fields < NUM_COLS) return false;
+
+	typedef TCString<CharType> chars;
+	house_numbers.Add(chars::Atoi(fields[COL_HOUSE]));
+	health_points.Add(chars::Atoi(fields[COL_HEALTH]));
+	time_points.Add(chars::Atoi(fields[COL_TIME]));
+	recommendations.Add(chars::Atoi(fields[COL_RECOMMENDATION]));
+	actions.Add(chars::Atoi(fields[COL_ACTION]));
+	trust_feedback.Add(chars::Atoi(fields[COL_TRUST_FEEDBACK]));
+	original_estimates.Add(chars::Atof(fields[COL_ORIGINAL_ESTIMATE]));
+	performance_history.Add(chars::Atoi(fields[COL_PERFORMANCE]));
+	threat_levels.Add(chars::Atof(fields[COL_THREAT]));
+	return true;
+}
+
+template CSVDATAREADER_API bool participant_columns::AddLine<TCHAR>(const TCHAR*, const TCHAR*);
+template CSVDATAREADER_API bool participant_columns::AddLine<ANSICHAR>(const ANSICHAR*, const ANSICHAR*);
+
+int32 participant_tail_parser::Feed(const ANSICHAR* bytes, int32 num, participant_columns& columns)
+{
+	offset += num;
+	carry.Append(bytes, num);
+
+	// Parse the complete lines, keep a partial last line for the next feed
+	int32 added = 0;
+	int32 begin = 0;
+	for (int32 i = 0; i < carry.Num(); i++)
+	{
+		if (carry[i] != '\n') continue;
+
+		if (!header_done)
+		{
+			header_done = true;
+		}
+		else if (columns.AddLine(carry.GetData() + begin, carry.GetData() + i))
+		{
+			added++;
+		}
+		begin = i + 1;
+	}
+	carry.RemoveAt(0, begin, false);
+	return added;
+}
+
+int32 participant_tail_parser::Finish(participant_columns& columns)
+{
+	int32 added = 0;
+	if (header_done && carry.Num() > 0 && columns.AddLine(carry.GetData(), carry.GetData() + carry.Num()))
+	{
+		added++;
+	}
+	carry.Reset();
+	return added;
+}
+
+void participant_tail_parser::Reset()
+{
+	offset = 0;
+	header_done = false;
+	carry.Reset();
+}
+
+participant_columns_ptr LoadParticipantColumns(const FString& filepath)
+{
+	// Taken before the read, so a file changed during it reloads next time
+	const file_version version = file_version::Of(filepath);
+	{
+		FScopeLock lock(&registry_lock);
+		if (const registry_entry* loaded = registry.Find(filepath))
+		{
+			participant_columns_ptr shared = loaded->columns.Pin();
+			if (shared.IsValid() && loaded->version == version) return shared;
+		}
+	}
+
+	TSharedRef<participant_columns, ESPMode::ThreadSafe> columns = MakeShared<participant_columns, ESPMode::ThreadSafe>();
+	if (filepath.EndsWith(TEXT(".gz")))
+	{
+		participant_file_stream stream;
+		if (!stream.Open(filepath) || !ParseParticipantStream(stream, -1, *columns)) return nullptr;
+	}
+	else
+	{
+		FString text;
+		if (!FFileHelper::LoadFileToString(text, *filepath)) return nullptr;
+		columns->Parse(text);
+	}
+
+	// Another actor may have loaded the same version meanwhile, keep the first
+	FScopeLock lock(&registry_lock);
+	registry_entry& entry = registry.FindOrAdd(filepath);
+	participant_columns_ptr existing = entry.columns.Pin();
+	if (existing.IsValid() && entry.version == version) return existing;
+
+	// Drop entries of files nobody holds any more
+	for (auto it = registry.CreateIterator(); it; ++it)
+	{
+		if (!it.Value().columns.IsValid() && it.Key() != filepath) it.RemoveCurrent();
+	}
+	participant_columns_ptr result = columns;
+	registry_entry& added = registry.FindOrAdd(filepath);
+	added.columns = result;
+	added.version = version;
+	return result;
+}
@@ -2,6 +2,11 @@
 
 
 #include "ParticipantSimulator.h"
+#include "TrustCrossValidation.h"
+#include "TrustTuner.h"
+#include "SyntheticStudy.h"
+#include "Optimizer.h"
+#include "HAL/PlatformFilemanager.h"
 
 // Sets default values
 AParticipantSimulator::AParticipantSimulator()
@@ -46,6 +51,11 @@ void AParticipantSimulator::SetSelectorData(int pid, int mission_num, int intera
 	SetDirectory();
 }
 
+void AParticipantSimulator::SetDataDirectory(const FString& dir)
+{
+	_base_dir = dir;
+}
+
 
 bool AParticipantSimulator::ReadData()
 {
@@ -53,65 +63,297 @@ bool AParticipantSimulator::ReadData()
 	FString filename = "Data.csv";
 	FString filepath = FPaths::Combine(_base_dir, filename);
 	//GEngine->AddOnScreenDebugMessage(-1, 10.f, FColor::Red, filename);
-	bool read = FFileHelper::LoadFileToString(data, *filepath);
-	ConvertDataToArrays();
-	num_sites = _trust_feedback.Num();
-	return read;
+	// Archived sessions may only keep the compressed file
+	if (!FPaths::FileExists(filepath) && FPaths::FileExists(filepath + TEXT(".gz")))
+	{
+		filepath += TEXT(".gz");
+	}
+	_columns = LoadParticipantColumns(filepath);
+	num_sites = _columns.IsValid() ? _columns->Num() : 0;
+	return _columns.IsValid();
+}
+
+void AParticipantSimulator::GetData(int site_idx, int& performance, int& trust_feedback)
+{
+	// No data loaded, or a site past the end
+	if (!_columns.IsValid() || !_columns->performance_history.IsValidIndex(site_idx) || !_columns->trust_feedback.IsValidIndex(site_idx))
+	{
+		performance = 0;
+		trust_feedback = 0;
+		return;
+	}
+	performance = _columns->performance_history[site_idx];
+	trust_feedback = _columns->trust_feedback[site_idx];
+}
+
+void AParticipantSimulator::GetColumns(TArray<int>& performance, TArray<int>& trust_feedback, TArray<float>& threat_levels,
+									  TArray<int>& health_points, TArray<int>& time_points, TArray<int>& recommendations) const
+{
+	auto copy = [](auto view, auto& out)
+	{
+		out.Reset(view.Num());
+		out.Append(view.GetData(), view.Num());
+	};
+	copy(GetPerformanceView(), performance);
+	copy(GetTrustFeedbackView(), trust_feedback);
+	copy(GetThreatLevelView(), threat_levels);
+	copy(GetHealthView(), health_points);
+	copy(GetTimeView(), time_points);
+	copy(GetRecommendationView(), recommendations);
+}
+
+TArrayView<const int> AParticipantSimulator::GetPerformanceView() const
+{
+	return _columns.IsValid() ? TArrayView<const int>(_columns->performance_history) : TArrayView<const int>();
+}
+
+TArrayView<const int> AParticipantSimulator::GetTrustFeedbackView() const
+{
+	return _columns.IsValid() ? TArrayView<const int>(_columns->trust_feedback) : TArrayView<const int>();
+}
+
+TArrayView<const float> AParticipantSimulator::GetThreatLevelView() const
+{
+	return _columns.IsValid() ? TArrayView<const float>(_columns->threat_levels) : TArrayView<const float>();
+}
+
+TArrayView<const int> AParticipantSimulator::GetHealthView() const
+{
+	return _columns.IsValid() ? TArrayView<const int>(_columns->health_points) : TArrayView<const int>();
+}
+
+TArrayView<const int> AParticipantSimulator::GetTimeView() const
+{
+	return _columns.IsValid() ? TArrayView<const int>(_columns->time_points) : TArrayView<const int>();
 }
 
-void AParticipantSimulator::ConvertDataToArrays()
+TArrayView<const int> AParticipantSimulator::GetRecommendationView() const
 {
-	int num_lines = data.ParseIntoArrayLines(lines);
+	return _columns.IsValid() ? TArrayView<const int>(_columns->recommendations) : TArrayView<const int>();
+}
 
-	for (int i = 1; i < num_lines; i++)
+bool AParticipantSimulator::StartFollow(AOptimizer* optimizer)
+{
+	reset();
+	FString filename = "Data.csv";
+	FString filepath = FPaths::Combine(_base_dir, filename);
+	_follow_file.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*filepath, true));
+	if (!_follow_file)
 	{
-		FString line = lines[i];
-		TArray<FString> values;
-		FString sep = ",";
-		int num_vals = line.ParseIntoArray(values, *sep);
-		house_numbers.Push(FCString::Atoi(*values[0]));
-		health_points.Push(FCString::Atoi(*values[7]));
-		time_points.Push(FCString::Atoi(*values[9]));
-		recommendations.Push(FCString::Atoi(*values[11]));
-		_trust_feedback.Push(FCString::Atoi(*values[12]));
-		original_estimates.Push(FCString::Atof(*values[13]));
-		performance_history.Push(FCString::Atoi(*values[14]));
-		threat_levels.Push(FCString::Atof(*values[16]));
+		num_sites = 0;
+		return false;
 	}
-	//GEngine->AddOnScreenDebugMessage(-1, 10.f, FColor::Green, FString::FromInt(num_lines));
+
+	_follow_columns = MakeShared<participant_columns, ESPMode::ThreadSafe>();
+	_columns = _follow_columns;
+	_follow_optimizer = optimizer;
+	_follow_parser.Reset();
+	num_sites = 0;
+	PollFollow();
+	return true;
 }
 
-void AParticipantSimulator::GetData(int site_idx, int& performance, int& trust_feedback)
+int AParticipantSimulator::PollFollow()
+{
+	if (!_follow_file || !_follow_columns.IsValid()) return 0;
+
+	int64 size = _follow_file->Size();
+	if (size < _follow_parser.offset)
+	{
+		// Truncated or replaced by a new session, start over from its header
+		_follow_file.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*FPaths::Combine(_base_dir, TEXT("Data.csv")), true));
+		_follow_columns = MakeShared<participant_columns, ESPMode::ThreadSafe>();
+		_columns = _follow_columns;
+		_follow_parser.Reset();
+		num_sites = 0;
+		if (AOptimizer* optimizer = _follow_optimizer.Get())
+		{
+			// Sites of the old file still queued go with its history
+			optimizer->DrainEvents();
+			optimizer->reset();
+		}
+		if (!_follow_file) return 0;
+		size = _follow_file->Size();
+	}
+	if (size <= _follow_parser.offset) return 0;
+
+	// Read only the bytes appended since the last poll
+	TArray<ANSICHAR> bytes;
+	bytes.SetNumUninitialized(static_cast<int32>(size - _follow_parser.offset));
+	if (!_follow_file->Seek(_follow_parser.offset) || !_follow_file->Read(reinterpret_cast<uint8*>(bytes.GetData()), bytes.Num()))
+	{
+		return 0;
+	}
+
+	const int first = _follow_columns->Num();
+	const int added = _follow_parser.Feed(bytes.GetData(), bytes.Num(), *_follow_columns);
+	PostFollowedSites(first);
+	return added;
+}
+
+void AParticipantSimulator::StopFollow()
+{
+	// A last row without its newline is complete once following stops
+	if (_follow_file && _follow_columns.IsValid())
+	{
+		PollFollow();
+		const int first = _follow_columns->Num();
+		_follow_parser.Finish(*_follow_columns);
+		PostFollowedSites(first);
+	}
+	_follow_file.Reset();
+	_follow_optimizer.Reset();
+	_follow_parser.Reset();
+}
+
+void AParticipantSimulator::PostFollowedSites(int first)
 {
-	performance = performance_history[site_idx];
-	trust_feedback = _trust_feedback[site_idx];
+	num_sites = _follow_columns->Num();
+	AOptimizer* optimizer = _follow_optimizer.Get();
+	if (!optimizer) return;
+	for (int i = first; i < num_sites; i++)
+	{
+		optimizer->PostEvent(_follow_columns->performance_history[i], _follow_columns->trust_feedback[i]);
+	}
+}
+
+bool AParticipantSimulator::ReplayEstimates(AOptimizer* optimizer, TArray<float>& estimates) const
+{
+	if (!optimizer || !_columns.IsValid()) return false;
+	optimizer->Replay(GetPerformanceView(), GetTrustFeedbackView(), estimates);
+	return true;
 }
 
 bool AParticipantSimulator::WriteTrustEstimates(const TArray<float>& new_estimates)
 {
+	if (!_columns.IsValid()) return false;
+
 	FString filename = "NewTrustEstimates.csv";
 	FString filepath = FPaths::Combine(_base_dir, filename);
 	FString _data = "TrustFeedback,OriginalEstimate,NewEstimate";
 	_data += LINE_TERMINATOR;
 	for (int i = 0; i < new_estimates.Num(); i++)
 	{
-		_data += FString::FromInt(_trust_feedback[i]) + ",";
-		_data += FString::SanitizeFloat(original_estimates[i]) + ",";
+		_data += FString::FromInt(_columns->trust_feedback[i]) + ",";
+		_data += FString::SanitizeFloat(_columns->original_estimates[i]) + ",";
 		_data += FString::SanitizeFloat(new_estimates[i]);
 		_data += LINE_TERMINATOR;
 	}
 	return FFileHelper::SaveStringToFile(_data, *filepath);
 }
 
+void AParticipantSimulator::GetHistory(trust_history& history) const
+{
+	if (!_columns.IsValid())
+	{
+		history.performance.clear();
+		history.trust_feedback.clear();
+		return;
+	}
+	history.performance.assign(_columns->performance_history.GetData(), _columns->performance_history.GetData() + _columns->Num());
+	history.trust_feedback.assign(_columns->trust_feedback.GetData(), _columns->trust_feedback.GetData() + _columns->Num());
+}
+
+bool AParticipantSimulator::CrossValidate(const TArray<AParticipantSimulator*>& participants, int num_folds,
+										  TArray<float>& log_likelihood, TArray<float>& rmse,
+										  float& total_log_likelihood, float& total_rmse)
+{
+	std::vector<trust_history> histories(participants.Num());
+	for (int j = 0; j < participants.Num(); j++)
+	{
+		if (participants[j]) participants[j]->GetHistory(histories[j]);
+	}
+
+	trust_cross_validation cv;
+	cv.num_folds = num_folds;
+	const bool ok = cv.run(histories);
+
+	log_likelihood.SetNum(participants.Num());
+	rmse.SetNum(participants.Num());
+	for (int j = 0; j < participants.Num(); j++)
+	{
+		log_likelihood[j] = static_cast<float>(cv.participant(j).logl);
+		rmse[j] = static_cast<float>(cv.participant(j).rmse);
+	}
+	total_log_likelihood = static_cast<float>(cv.aggregate().logl);
+	total_rmse = static_cast<float>(cv.aggregate().rmse);
+	return ok;
+}
+
+bool AParticipantSimulator::TuneProfile(const TArray<AParticipantSimulator*>& participants, const FString& output_file,
+										float& latency_us, float& deviation)
+{
+	std::vector<trust_history> histories(participants.Num());
+	for (int j = 0; j < participants.Num(); j++)
+	{
+		if (participants[j]) participants[j]->GetHistory(histories[j]);
+	}
+
+	trust_profile_tuner tuner;
+	if (!tuner.run(histories)) return false;
+
+	FString _data = "Algorithm,MaxEval,EvalCap,XtolRel,FtolRel,FtolAbs,Reparameterized,LatencyUs,MaxLatencyUs,Deviation,MeanEvals,Timed,Pareto";
+	_data += LINE_TERMINATOR;
+	for (const trust_tuning_point& point : tuner.points())
+	{
+		_data += FString(nlopt::algorithm_name(point.profile.algorithm)).Replace(TEXT(","), TEXT(";")) + ",";
+		_data += FString::FromInt(point.profile.maxeval) + ",";
+		_data += FString::FromInt(point.profile.max_evals) + ",";
+		_data += FString::SanitizeFloat(point.profile.xtol_rel) + ",";
+		_data += FString::SanitizeFloat(point.profile.ftol_rel) + ",";
+		_data += FString::SanitizeFloat(point.profile.ftol_abs) + ",";
+		_data += point.profile.reparameterize ? "1," : "0,";
+		_data += FString::SanitizeFloat(point.latency_us) + ",";
+		_data += FString::SanitizeFloat(point.max_latency_us) + ",";
+		_data += FString::SanitizeFloat(point.deviation) + ",";
+		_data += FString::SanitizeFloat(point.mean_evals) + ",";
+		_data += point.timed ? "1," : "0,";
+		_data += point.pareto ? "1" : "0";
+		_data += LINE_TERMINATOR;
+	}
+
+	const trust_tuning_point& best = tuner.recommended();
+	UE_LOG(LogTemp, Display, TEXT("Recommended trust profile: %s, maxeval %d, eval cap %d, xtol_rel %g, ftol_rel %g, ftol_abs %g%s (%.1f us per update, deviation %.4f)"),
+		   ANSI_TO_TCHAR(nlopt::algorithm_name(best.profile.algorithm)), best.profile.maxeval, best.profile.max_evals,
+		   best.profile.xtol_rel, best.profile.ftol_rel, best.profile.ftol_abs,
+		   best.profile.reparameterize ? TEXT(", reparameterized") : TEXT(""), best.latency_us, best.deviation);
+	latency_us = static_cast<float>(best.latency_us);
+	deviation = static_cast<float>(best.deviation);
+	return FFileHelper::SaveStringToFile(_data, *output_file);
+}
+
+int AParticipantSimulator::GenerateStudy(const FString& root, float alpha0, float beta0, float ws, float wf,
+										int num_participants, int num_sites, int interaction_mode, int mission_num, int seed)
+{
+	static const TCHAR* modes[] = { TEXT("Constant"), TEXT("State dependent") };
+	if (interaction_mode < 0 || interaction_mode > 1) return 0;
+
+	trust_synthetic_config config;
+	config.x[0] = alpha0;
+	config.x[1] = beta0;
+	config.x[2] = ws;
+	config.x[3] = wf;
+	config.num_participants = num_participants;
+	config.min_sites = config.max_sites = num_sites;
+	config.seed = static_cast<uint32>(seed);
+
+	const FString dir = root.IsEmpty() ? FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("SyntheticStudy")) : root;
+	const int32 num_written = WriteSyntheticStudy(config, dir, modes[interaction_mode], mission_num);
+	if (num_written < 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("GenerateStudy: %s already holds a study of this mode and mission, nothing was written"), *dir);
+		return 0;
+	}
+	return num_written;
+}
 
 void AParticipantSimulator::reset()
 {
-	house_numbers.Empty();
-	health_points.Empty();
-	time_points.Empty();
-	recommendations.Empty();
-	_trust_feedback.Empty();
-	original_estimates.Empty();
-	performance_history.Empty();
-	threat_levels.Empty();
-}
\ No newline at end of file
+	// Drop a followed file as it is, its sites belong to the old session
+	_follow_file.Reset();
+	_follow_optimizer.Reset();
+	_follow_parser.Reset();
+	_follow_columns.Reset();
+	_columns.Reset();
+	num_sites = -1;
+}
@@ -0,0 +1,288 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ReplayBenchmark.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformMemory.h"
+#include "HAL/PlatformTLS.h"
+#include "Misc/CommandLine.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Parse.h"
+#include "Misc/Paths.h"
+#include "Engine/World.h"
+#include "ParticipantSimulator.h"
+#include "Optimizer.h"
+#include "SyntheticStudy.h"
+#include <atomic>
+
+namespace
+{
+	// Forwards to the engine allocator and counts the allocations made by
+	// one thread. Only installed at startup, on request, and left in place,
+	// since other threads may still be inside it when counting stops.
+	class FCountingMalloc final : public FMalloc
+	{
+	public:
+		explicit FCountingMalloc(FMalloc* InInner) : Inner(InInner) {}
+
+		FMalloc* Inner;
+		std::atomic<uint32> CountedThread{ 0 };
+		std::atomic<uint64> Allocations{ 0 };
+
+		virtual void* Malloc(SIZE_T Count, uint32 Alignment) override
+		{
+			Tally();
+			return Inner->Malloc(Count, Alignment);
+		}
+		virtual void* TryMalloc(SIZE_T Count, uint32 Alignment) override
+		{
+			Tally();
+			return Inner->TryMalloc(Count, Alignment);
+		}
+		virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override
+		{
+			if (!Original) Tally();
+			return Inner->Realloc(Original, Count, Alignment);
+		}
+		virtual void* TryRealloc(void* Original, SIZE_T Count, uint32 Alignment) override
+		{
+			if (!Original) Tally();
+			return Inner->TryRealloc(Original, Count, Alignment);
+		}
+		virtual void Free(void* Original) override { Inner->Free(Original); }
+		virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override { return Inner->QuantizeSize(Count, Alignment); }
+		virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override { return Inner->GetAllocationSize(Original, SizeOut); }
+		virtual void Trim(bool bTrimThreadCaches) override { Inner->Trim(bTrimThreadCaches); }
+		virtual void SetupTLSCachesOnCurrentThread() override { Inner->SetupTLSCachesOnCurrentThread(); }
+		virtual void ClearAndDisableTLSCachesOnCurrentThread() override { Inner->ClearAndDisableTLSCachesOnCurrentThread(); }
+		virtual void InitializeStatsMetadata() override { Inner->InitializeStatsMetadata(); }
+		virtual void UpdateStats() override { Inner->UpdateStats(); }
+		virtual void GetAllocatorStats(FGenericMemoryStats& OutStats) override { Inner->GetAllocatorStats(OutStats); }
+		virtual void DumpAllocatorStats(FOutputDevice& Ar) override { Inner->DumpAllocatorStats(Ar); }
+		virtual bool IsInternallyThreadSafe() const override { return Inner->IsInternallyThreadSafe(); }
+		virtual bool ValidateHeap() override { return Inner->ValidateHeap(); }
+		virtual const TCHAR* GetDescriptiveName() override { return TEXT("CountingMalloc"); }
+
+	private:
+		void Tally()
+		{
+			if (CountedThread.load(std::memory_order_relaxed) == FPlatformTLS::GetCurrentThreadId())
+			{
+				Allocations.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+	};
+
+	FCountingMalloc* allocation_counter = nullptr;
+
+	enum stage { stage_load, stage_fit, stage_export, NUM_STAGES };
+	const TCHAR* stage_names[NUM_STAGES] = { TEXT("load"), TEXT("fit"), TEXT("export") };
+
+	struct stage_result
+	{
+		double seconds = 0.;
+		int64 rows = 0;
+		int64 fits = 0;
+		int64 bytes = 0;
+		uint64 allocations = 0;
+		// Largest growth of the process's physical memory over one call of
+		// the stage, worst of all runs
+		int64 peak_bytes = 0;
+	};
+
+	struct bench_metric
+	{
+		FString name;
+		double value;
+		bool higher_is_better;
+	};
+
+	const int RUNS = 3;
+}
+
+void InstallAllocationCounter()
+{
+	if (allocation_counter || !FParse::Param(FCommandLine::Get(), TEXT("CountAllocations"))) return;
+	allocation_counter = new FCountingMalloc(GMalloc);
+	GMalloc = allocation_counter;
+}
+
+// Replay a fixed synthetic study through the same calls a study run makes,
+// AParticipantSimulator::ReadData, ReplayEstimates and WriteTrustEstimates,
+// timing each stage separately. The best of RUNS runs is reported per
+// stage, with the allocations made on this thread when the engine was
+// started with -CountAllocations, and the largest growth of physical
+// memory over one call of the stage (FPlatformMemory::GetStats sampled
+// before and after each call). These are compared with the stored
+// baseline for the same study size: a throughput more than tolerance
+// below the baseline, or allocations or peak memory more than tolerance
+// above it, is reported as a regression. The baseline is written on the
+// first run, or when "save" is given. Fits bypass the fit cache.
+// Usage: trust.BenchReplay [participants] [sites] [tolerance] [save]
+static void BenchReplay(const TArray<FString>& Args, UWorld* World)
+{
+	if (!World)
+	{
+		UE_LOG(LogTemp, Error, TEXT("trust.BenchReplay needs a world to spawn its actors in"));
+		return;
+	}
+
+	trust_synthetic_config config;
+	config.num_participants = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 100;
+	config.min_sites = config.max_sites = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 200;
+	const double tolerance = Args.Num() > 2 ? FCString::Atod(*Args[2]) : 0.1;
+	const bool save = Args.Contains(TEXT("save"));
+
+	const FString bench_dir = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Benchmarks"));
+	const FString study_dir = FPaths::Combine(bench_dir, TEXT("ReplayStudy"));
+	const FString baseline_path = FPaths::Combine(bench_dir,
+		FString::Printf(TEXT("ReplayBaseline_%d_%d.csv"), config.num_participants, config.max_sites));
+
+	// The same seed always gives the same study
+	IFileManager::Get().DeleteDirectory(*study_dir, false, true);
+	if (WriteSyntheticStudy(config, study_dir) != config.num_participants)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not write the benchmark study to %s"), *study_dir);
+		return;
+	}
+	TArray<FString> files;
+	IFileManager::Get().FindFilesRecursive(files, *study_dir, TEXT("Data.csv"), true, false);
+	files.Sort();
+
+	AParticipantSimulator* participant = World->SpawnActor<AParticipantSimulator>();
+	AOptimizer* optimizer = World->SpawnActor<AOptimizer>();
+	if (!participant || !optimizer) return;
+	optimizer->use_fit_cache = false;
+
+	FCountingMalloc* counter = allocation_counter;
+	if (counter) counter->CountedThread = FPlatformTLS::GetCurrentThreadId();
+	auto allocations = [counter]() -> uint64 { return counter ? counter->Allocations.load() : 0; };
+
+	stage_result best[NUM_STAGES];
+	TArray<float> estimates;
+	for (int run = 0; run < RUNS; run++)
+	{
+		stage_result stages[NUM_STAGES];
+		auto measure = [&allocations](stage_result& result, auto&& work)
+		{
+			const uint64 before = allocations();
+			const int64 used_before = FPlatformMemory::GetStats().UsedPhysical;
+			const double start = FPlatformTime::Seconds();
+			work();
+			result.seconds += FPlatformTime::Seconds() - start;
+			result.allocations += allocations() - before;
+			const int64 used_after = FPlatformMemory::GetStats().UsedPhysical;
+			result.peak_bytes = FMath::Max(result.peak_bytes, used_after - used_before);
+		};
+
+		for (const FString& file : files)
+		{
+			const FString dir = FPaths::GetPath(file);
+			participant->SetDataDirectory(dir);
+
+			measure(stages[stage_load], [&]() { participant->ReadData(); });
+			stages[stage_load].rows += participant->num_sites;
+			stages[stage_load].bytes += IFileManager::Get().FileSize(*file);
+
+			measure(stages[stage_fit], [&]() { participant->ReplayEstimates(optimizer, estimates); });
+			stages[stage_fit].rows += estimates.Num();
+			stages[stage_fit].fits += FMath::Max(estimates.Num() - 1, 0);
+
+			measure(stages[stage_export], [&]() { participant->WriteTrustEstimates(estimates); });
+			stages[stage_export].rows += estimates.Num();
+			stages[stage_export].bytes += IFileManager::Get().FileSize(*FPaths::Combine(dir, TEXT("NewTrustEstimates.csv")));
+		}
+
+		for (int s = 0; s < NUM_STAGES; s++)
+		{
+			const int64 peak_bytes = FMath::Max(best[s].peak_bytes, stages[s].peak_bytes);
+			if (run == 0 || stages[s].seconds < best[s].seconds) best[s] = stages[s];
+			best[s].peak_bytes = peak_bytes;
+		}
+	}
+	if (counter) counter->CountedThread = 0;
+	participant->Destroy();
+	optimizer->Destroy();
+
+	TArray<bench_metric> metrics;
+	UE_LOG(LogTemp, Display, TEXT("%d participants x %d sites, best of %d runs"), config.num_participants, config.max_sites, RUNS);
+	UE_LOG(LogTemp, Display, TEXT("stage      seconds       rows/s       fits/s       MB/s  allocs/row  peak MB"));
+	for (int s = 0; s < NUM_STAGES; s++)
+	{
+		const stage_result& r = best[s];
+		const double seconds = FMath::Max(r.seconds, 1e-9);
+		const double rows_per_s = r.rows / seconds;
+		const double fits_per_s = r.fits / seconds;
+		const double mb_per_s = r.bytes / seconds / (1024. * 1024.);
+		const double allocs_per_row = r.rows > 0 ? (double)r.allocations / r.rows : 0.;
+		const double peak_mb = r.peak_bytes / (1024. * 1024.);
+		UE_LOG(LogTemp, Display, TEXT("%-8s %9.3f %12.0f %12.0f %10.1f %11.2f %8.1f"), stage_names[s], r.seconds,
+			   rows_per_s, fits_per_s, mb_per_s, allocs_per_row, peak_mb);
+
+		metrics.Add({ FString(stage_names[s]) + TEXT("_rows_per_s"), rows_per_s, true });
+		if (r.fits > 0) metrics.Add({ FString(stage_names[s]) + TEXT("_fits_per_s"), fits_per_s, true });
+		if (r.bytes > 0) metrics.Add({ FString(stage_names[s]) + TEXT("_bytes_per_s"), r.bytes / seconds, true });
+		if (counter) metrics.Add({ FString(stage_names[s]) + TEXT("_allocs_per_row"), allocs_per_row, false });
+		metrics.Add({ FString(stage_names[s]) + TEXT("_peak_mb"), peak_mb, false });
+	}
+	if (!counter)
+	{
+		UE_LOG(LogTemp, Display, TEXT("Allocations are not counted, start with -CountAllocations to include them"));
+	}
+
+	// Compare with the baseline
+	TArray<FString> lines;
+	if (!save && FFileHelper::LoadFileToStringArray(lines, *baseline_path))
+	{
+		int regressions = 0;
+		for (const FString& line : lines)
+		{
+			FString name, value;
+			if (!line.Split(TEXT(","), &name, &value)) continue;
+			const bench_metric* metric = metrics.FindByPredicate([&name](const bench_metric& m) { return m.name == name; });
+			if (!metric) continue;
+
+			const double base = FCString::Atod(*value);
+			const bool regressed = metric->higher_is_better
+				? metric->value < base * (1. - tolerance)
+				: metric->value > base * (1. + tolerance) && metric->value - base > 1e-9;
+			const double change = base != 0. ? 100. * (metric->value / base - 1.) : 0.;
+			if (regressed)
+			{
+				regressions++;
+				UE_LOG(LogTemp, Warning, TEXT("Regression: %s %.4g vs baseline %.4g (%+.1f%%)"), *name, metric->value, base, change);
+			}
+			else
+			{
+				UE_LOG(LogTemp, Display, TEXT("%s %.4g vs baseline %.4g (%+.1f%%)"), *name, metric->value, base, change);
+			}
+		}
+		if (regressions > 0)
+		{
+			UE_LOG(LogTemp, Error, TEXT("trust.BenchReplay: %d metrics regressed beyond %.0f%% of %s"), regressions, 100. * tolerance, *baseline_path);
+		}
+		else
+		{
+			UE_LOG(LogTemp, Display, TEXT("trust.BenchReplay: within %.0f%% of the baseline"), 100. * tolerance);
+		}
+		return;
+	}
+
+	FString _data = "Metric,Value";
+	_data += LINE_TERMINATOR;
+	for (const bench_metric& metric : metrics)
+	{
+		_data += metric.name + "," + FString::Printf(TEXT("%.17g"), metric.value);
+		_data += LINE_TERMINATOR;
+	}
+	if (FFileHelper::SaveStringToFile(_data, *baseline_path))
+	{
+		UE_LOG(LogTemp, Display, TEXT("Baseline written to %s"), *baseline_path);
+	}
+}
+
+static FAutoConsoleCommand BenchReplayCommand(
+	TEXT("trust.BenchReplay"),
+	TEXT("Times the load, fit and export stages of a study replay on a synthetic study and compares with a stored baseline"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchReplay));
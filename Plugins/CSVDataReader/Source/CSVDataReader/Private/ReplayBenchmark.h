@@ -0,0 +1,10 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// With -CountAllocations on the command line, wrap GMalloc in the counter
+// trust.BenchReplay reports allocations with. Called once, from
+// FCSVDataReaderModule::StartupModule.
+void InstallAllocationCounter();
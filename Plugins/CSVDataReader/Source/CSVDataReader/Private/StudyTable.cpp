@@ -0,0 +1,413 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "StudyTable.h"
+#include "ParticipantArchive.h"
+#include "TrustPopulation.h"
+#include "Async/ParallelFor.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+namespace
+{
+	const TCHAR* column_names[] = {
+		TEXT("Participant"), TEXT("Mission"), TEXT("Mode"), TEXT("Site"), TEXT("House"), TEXT("Health"), TEXT("Time"),
+		TEXT("Recommendation"), TEXT("Action"), TEXT("TrustFeedback"), TEXT("OriginalEstimate"), TEXT("Performance"), TEXT("ThreatLevel")
+	};
+
+	// Interaction mode directories, as AParticipantSimulator::mode_names
+	const int NUM_MODES = 2;
+	const TCHAR* mode_names[NUM_MODES] = { TEXT("Constant"), TEXT("State dependent") };
+
+	enum class zone_match { none, some, all };
+
+	zone_match classify(study_op op, double lo, double hi, double v)
+	{
+		switch (op)
+		{
+		case study_op::lt: return hi < v ? zone_match::all : (lo >= v ? zone_match::none : zone_match::some);
+		case study_op::le: return hi <= v ? zone_match::all : (lo > v ? zone_match::none : zone_match::some);
+		case study_op::gt: return lo > v ? zone_match::all : (hi <= v ? zone_match::none : zone_match::some);
+		case study_op::ge: return lo >= v ? zone_match::all : (hi < v ? zone_match::none : zone_match::some);
+		case study_op::eq: return (lo == v && hi == v) ? zone_match::all : ((v < lo || v > hi) ? zone_match::none : zone_match::some);
+		case study_op::ne: return (v < lo || v > hi) ? zone_match::all : ((lo == v && hi == v) ? zone_match::none : zone_match::some);
+		}
+		return zone_match::some;
+	}
+
+	// One branch-free loop per operator, so the compiler can vectorize it
+	template <typename A, typename B>
+	void scan(const A* a, B b, int32 b_stride, study_op op, int32 n, uint8* mask)
+	{
+		auto rhs = [&](int32 i) { return b[i * b_stride]; };
+		switch (op)
+		{
+		case study_op::lt: for (int32 i = 0; i < n; i++) mask[i] &= (double)a[i] < (double)rhs(i); break;
+		case study_op::le: for (int32 i = 0; i < n; i++) mask[i] &= (double)a[i] <= (double)rhs(i); break;
+		case study_op::eq: for (int32 i = 0; i < n; i++) mask[i] &= (double)a[i] == (double)rhs(i); break;
+		case study_op::ne: for (int32 i = 0; i < n; i++) mask[i] &= (double)a[i] != (double)rhs(i); break;
+		case study_op::ge: for (int32 i = 0; i < n; i++) mask[i] &= (double)a[i] >= (double)rhs(i); break;
+		case study_op::gt: for (int32 i = 0; i < n; i++) mask[i] &= (double)a[i] > (double)rhs(i); break;
+		}
+	}
+
+	template <typename A>
+	void scan_against(const A* a, const study_predicate& predicate, const int32* other_ints, const float* other_floats, int32 n, uint8* mask)
+	{
+		if (other_ints) scan(a, other_ints, 1, predicate.op, n, mask);
+		else if (other_floats) scan(a, other_floats, 1, predicate.op, n, mask);
+		else scan(a, &predicate.value, 0, predicate.op, n, mask);
+	}
+}
+
+int32 study_table::LoadStudy(const FString& root)
+{
+	TArray<FString> files;
+	IFileManager::Get().FindFilesRecursive(files, *root, TEXT("Data.csv"), true, false);
+
+	// Compressed files, unless the plain file is next to them
+	TArray<FString> compressed;
+	IFileManager::Get().FindFilesRecursive(compressed, *root, TEXT("Data.csv.gz"), true, false);
+	for (const FString& file : compressed)
+	{
+		if (!files.Contains(file.LeftChop(3))) files.Add(file);
+	}
+	files.Sort();
+
+	// Files are independent, read and parse them in parallel
+	TArray<participant_columns_ptr> loaded;
+	loaded.SetNum(files.Num());
+	ParallelFor(files.Num(), [&](int32 k)
+	{
+		loaded[k] = LoadParticipantColumns(files[k]);
+	});
+
+	int32 num_loaded = 0;
+	for (int32 k = 0; k < files.Num(); k++)
+	{
+		if (!loaded[k].IsValid()) continue;
+		AppendFile(files[k], *loaded[k]);
+		num_loaded++;
+	}
+	return num_loaded;
+}
+
+int32 study_table::LoadArchive(const FString& archive_path)
+{
+	return ForEachArchivedParticipant(archive_path, [this](const FString& path, participant_columns_ptr columns)
+	{
+		AppendFile(path, *columns);
+	});
+}
+
+void study_table::AppendFile(const FString& filepath, const participant_columns& columns)
+{
+	// .../ParticipantNNN/<mode>/MissionM/Data.csv
+	const FString mission_dir = FPaths::GetPath(filepath);
+	const FString mode_dir = FPaths::GetPath(mission_dir);
+	const FString participant_dir = FPaths::GetPath(mode_dir);
+	const FString mission_name = FPaths::GetCleanFilename(mission_dir);
+	const FString mode_name = FPaths::GetCleanFilename(mode_dir);
+	const FString participant_name = FPaths::GetCleanFilename(participant_dir);
+
+	int mode = -1;
+	for (int m = 0; m < NUM_MODES; m++)
+	{
+		if (mode_name == mode_names[m]) mode = m;
+	}
+	const int pid = FCString::Atoi(*participant_name.RightChop(FCString::Strlen(TEXT("Participant"))));
+	const int mission = FCString::Atoi(*mission_name.RightChop(FCString::Strlen(TEXT("Mission"))));
+	Append(pid, mission, mode, columns);
+}
+
+void study_table::Append(int pid, int mission, int mode, const participant_columns& columns)
+{
+	const int32 first_row = _num_rows;
+	const int32 num = columns.Num();
+
+	auto add_constant = [num](TArray<int32>& column, int32 value)
+	{
+		for (int32 i = 0; i < num; i++) column.Add(value);
+	};
+	add_constant(_ints[(int)study_column::participant], pid);
+	add_constant(_ints[(int)study_column::mission], mission);
+	add_constant(_ints[(int)study_column::mode], mode);
+	TArray<int32>& site = _ints[(int)study_column::site];
+	for (int32 i = 0; i < num; i++) site.Add(i);
+
+	_ints[(int)study_column::house].Append(columns.house_numbers.GetData(), num);
+	_ints[(int)study_column::health].Append(columns.health_points.GetData(), num);
+	_ints[(int)study_column::time].Append(columns.time_points.GetData(), num);
+	_ints[(int)study_column::recommendation].Append(columns.recommendations.GetData(), num);
+	_ints[(int)study_column::action].Append(columns.actions.GetData(), num);
+	_ints[(int)study_column::trust_feedback].Append(columns.trust_feedback.GetData(), num);
+	_ints[(int)study_column::performance].Append(columns.performance_history.GetData(), num);
+	_floats[(int)study_column::original_estimate].Append(columns.original_estimates.GetData(), num);
+	_floats[(int)study_column::threat_level].Append(columns.threat_levels.GetData(), num);
+
+	_num_rows += num;
+	ExtendZones(first_row);
+}
+
+void study_table::Empty()
+{
+	for (int c = 0; c < (int)study_column::count; c++)
+	{
+		_ints[c].Empty();
+		_floats[c].Empty();
+		_zone_min[c].Empty();
+		_zone_max[c].Empty();
+	}
+	_num_rows = 0;
+}
+
+void study_table::ExtendZones(int32 first_row)
+{
+	const int32 first_zone = first_row / ZONE_ROWS;
+	const int32 num_zones = (_num_rows + ZONE_ROWS - 1) / ZONE_ROWS;
+	for (int c = 0; c < (int)study_column::count; c++)
+	{
+		const study_column column = (study_column)c;
+		_zone_min[c].SetNum(num_zones);
+		_zone_max[c].SetNum(num_zones);
+		for (int32 z = first_zone; z < num_zones; z++)
+		{
+			const int32 end = FMath::Min(_num_rows, (z + 1) * ZONE_ROWS);
+			double lo = Get(column, z * ZONE_ROWS), hi = lo;
+			for (int32 row = z * ZONE_ROWS + 1; row < end; row++)
+			{
+				const double v = Get(column, row);
+				lo = FMath::Min(lo, v);
+				hi = FMath::Max(hi, v);
+			}
+			_zone_min[c][z] = lo;
+			_zone_max[c][z] = hi;
+		}
+	}
+}
+
+double study_table::Get(study_column column, int32 row) const
+{
+	return IsFloat(column) ? _floats[(int)column][row] : _ints[(int)column][row];
+}
+
+void study_table::ScanZone(const study_predicate& predicate, int32 begin, int32 end, uint8* mask) const
+{
+	const int c = (int)predicate.column;
+	const int32* other_ints = nullptr;
+	const float* other_floats = nullptr;
+	if (predicate.other != study_column::count)
+	{
+		const int o = (int)predicate.other;
+		if (IsFloat(predicate.other)) other_floats = _floats[o].GetData() + begin;
+		else other_ints = _ints[o].GetData() + begin;
+	}
+
+	if (IsFloat(predicate.column)) scan_against(_floats[c].GetData() + begin, predicate, other_ints, other_floats, end - begin, mask);
+	else scan_against(_ints[c].GetData() + begin, predicate, other_ints, other_floats, end - begin, mask);
+}
+
+bool study_table::Select(const TArray<study_predicate>& predicates, TArray<int32>& selection) const
+{
+	selection.Reset();
+	for (const study_predicate& predicate : predicates)
+	{
+		if (predicate.column >= study_column::count || predicate.other > study_column::count) return false;
+	}
+
+	const int32 num_zones = (_num_rows + ZONE_ROWS - 1) / ZONE_ROWS;
+	TArray<const study_predicate*, TInlineAllocator<8>> partial;
+	uint8 mask[ZONE_ROWS];
+
+	for (int32 z = 0; z < num_zones; z++)
+	{
+		const int32 begin = z * ZONE_ROWS;
+		const int32 end = FMath::Min(_num_rows, begin + ZONE_ROWS);
+
+		// Settle what the zone map can, keep the rest for the scan
+		partial.Reset();
+		bool skip = false;
+		for (const study_predicate& predicate : predicates)
+		{
+			if (predicate.other != study_column::count)
+			{
+				partial.Add(&predicate);
+				continue;
+			}
+			const int c = (int)predicate.column;
+			const zone_match match = classify(predicate.op, _zone_min[c][z], _zone_max[c][z], predicate.value);
+			if (match == zone_match::none)
+			{
+				skip = true;
+				break;
+			}
+			if (match == zone_match::some) partial.Add(&predicate);
+		}
+		if (skip) continue;
+
+		if (partial.Num() == 0)
+		{
+			for (int32 row = begin; row < end; row++) selection.Add(row);
+			continue;
+		}
+
+		FMemory::Memset(mask, 1, end - begin);
+		for (const study_predicate* predicate : partial)
+		{
+			ScanZone(*predicate, begin, end, mask);
+		}
+		for (int32 i = 0; i < end - begin; i++)
+		{
+			if (mask[i]) selection.Add(begin + i);
+		}
+	}
+	return true;
+}
+
+void study_table::GetHistories(const TArray<int32>& selection, std::vector<trust_history>& histories) const
+{
+	histories.clear();
+	const TArray<int32>& participant = _ints[(int)study_column::participant];
+	const TArray<int32>& mission = _ints[(int)study_column::mission];
+	const TArray<int32>& mode = _ints[(int)study_column::mode];
+	const TArray<int32>& performance = _ints[(int)study_column::performance];
+	const TArray<int32>& trust_feedback = _ints[(int)study_column::trust_feedback];
+
+	int32 last = -1;
+	for (int32 row : selection)
+	{
+		// A file's rows are adjacent, so a gap means sites were filtered out
+		if (last < 0 || row != last + 1 || participant[row] != participant[last] || mission[row] != mission[last] || mode[row] != mode[last])
+		{
+			histories.emplace_back();
+		}
+		histories.back().performance.push_back(performance[row]);
+		histories.back().trust_feedback.push_back(trust_feedback[row]);
+		last = row;
+	}
+}
+
+bool study_table::WriteCSV(const TArray<int32>& selection, const FString& filepath) const
+{
+	FString _data;
+	for (int c = 0; c < (int)study_column::count; c++)
+	{
+		if (c > 0) _data += ",";
+		_data += column_names[c];
+	}
+	_data += LINE_TERMINATOR;
+
+	for (int32 row : selection)
+	{
+		for (int c = 0; c < (int)study_column::count; c++)
+		{
+			if (c > 0) _data += ",";
+			if (IsFloat((study_column)c)) _data += FString::SanitizeFloat(_floats[c][row]);
+			else _data += FString::FromInt(_ints[c][row]);
+		}
+		_data += LINE_TERMINATOR;
+	}
+	return FFileHelper::SaveStringToFile(_data, *filepath);
+}
+
+static bool ParseColumn(const FString& name, study_column& column)
+{
+	for (int c = 0; c < (int)study_column::count; c++)
+	{
+		if (name.Equals(column_names[c], ESearchCase::IgnoreCase))
+		{
+			column = (study_column)c;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool ParseOp(const FString& name, study_op& op)
+{
+	const TCHAR* op_names[] = { TEXT("<"), TEXT("<="), TEXT("=="), TEXT("!="), TEXT(">="), TEXT(">") };
+	for (int k = 0; k < 6; k++)
+	{
+		if (name == op_names[k])
+		{
+			op = (study_op)k;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Load a study directory or archive, select the rows matching every
+// "Column op value" (or "Column op Column") triple, and log how many rows
+// and histories match. Histories are split where the selection skips
+// rows, see study_table::GetHistories. With out=<file>, the selected rows
+// are written to that CSV file.
+// e.g. trust.QueryStudy Study.tar.gz TrustFeedback < 50 Action != Recommendation out=Low.csv
+// Usage: trust.QueryStudy <root|archive> [Column op value]... [out=file]
+static void QueryStudy(const TArray<FString>& Args)
+{
+	if (Args.Num() < 1)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Usage: trust.QueryStudy <root|archive> [Column op value]... [out=file]"));
+		return;
+	}
+
+	FString out_path;
+	TArray<FString> terms;
+	for (int32 k = 1; k < Args.Num(); k++)
+	{
+		if (Args[k].StartsWith(TEXT("out="))) out_path = Args[k].Mid(4);
+		else terms.Add(Args[k]);
+	}
+
+	TArray<study_predicate> predicates;
+	if (terms.Num() % 3 != 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("trust.QueryStudy: predicates are Column op value triples"));
+		return;
+	}
+	for (int32 k = 0; k < terms.Num(); k += 3)
+	{
+		study_predicate predicate;
+		if (!ParseColumn(terms[k], predicate.column) || !ParseOp(terms[k + 1], predicate.op))
+		{
+			UE_LOG(LogTemp, Error, TEXT("trust.QueryStudy: cannot parse %s %s %s"), *terms[k], *terms[k + 1], *terms[k + 2]);
+			return;
+		}
+		predicate.value = 0.;
+		if (!ParseColumn(terms[k + 2], predicate.other)) predicate.value = FCString::Atod(*terms[k + 2]);
+		predicates.Add(predicate);
+	}
+
+	study_table table;
+	const int32 num_files = IFileManager::Get().DirectoryExists(*Args[0]) ? table.LoadStudy(Args[0]) : table.LoadArchive(Args[0]);
+	if (num_files <= 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("trust.QueryStudy: no study files loaded from %s"), *Args[0]);
+		return;
+	}
+
+	TArray<int32> selection;
+	if (!table.Select(predicates, selection))
+	{
+		UE_LOG(LogTemp, Error, TEXT("trust.QueryStudy: the study has no column for a predicate"));
+		return;
+	}
+	std::vector<trust_history> histories;
+	table.GetHistories(selection, histories);
+	UE_LOG(LogTemp, Display, TEXT("trust.QueryStudy: %d of %d rows in %d files match, in %d histories"),
+		   selection.Num(), table.Num(), num_files, (int32)histories.size());
+
+	if (!out_path.IsEmpty())
+	{
+		if (table.WriteCSV(selection, out_path)) UE_LOG(LogTemp, Display, TEXT("Selected rows written to %s"), *out_path);
+		else UE_LOG(LogTemp, Error, TEXT("trust.QueryStudy: cannot write %s"), *out_path);
+	}
+}
+
+static FAutoConsoleCommand QueryStudyCommand(
+	TEXT("trust.QueryStudy"),
+	TEXT("Selects the rows of a study matching column predicates, counts their histories and optionally writes them to CSV"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&QueryStudy));
@@ -0,0 +1,154 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SyntheticStudy.h"
+#include "StudyTable.h"
+#include "Async/ParallelFor.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+namespace
+{
+	const int NUM_COLS = 17;
+	const int START_HEALTH = 100;
+	const int FAILURE_DAMAGE = 10;
+
+	// Header of a written file, columns the reader skips are left unnamed
+	const TCHAR* header = TEXT("House,,,,,,,Health,,Time,,Recommendation,TrustFeedback,OriginalEstimate,Performance,Action,ThreatLevel");
+
+	// Participant directory name as AParticipantSimulator::SetDirectory
+	FString participant_dir(int pid)
+	{
+		FString name = "Participant0";
+		if (pid < 10) name += "0";
+		return name + FString::FromInt(pid);
+	}
+
+	// Stream of the columns the model does not read, apart from the model's own
+	uint32 columns_seed(const trust_synthetic_config& config, int j)
+	{
+		return HashCombine(config.seed ^ 0x5eed5eedu, static_cast<uint32>(j));
+	}
+}
+
+void MakeSyntheticColumns(const trust_history& history, uint32 seed, participant_columns& columns)
+{
+	const int num = static_cast<int>(history.performance.size());
+	for (TArray<int>* column : { &columns.house_numbers, &columns.health_points, &columns.time_points, &columns.recommendations,
+								 &columns.actions, &columns.trust_feedback, &columns.performance_history })
+	{
+		column->Reset(num);
+	}
+	columns.original_estimates.Reset(num);
+	columns.threat_levels.Reset(num);
+
+	FRandomStream rng(static_cast<int32>(seed));
+	int health = START_HEALTH;
+	int time = 0;
+	for (int i = 0; i < num; i++)
+	{
+		const int performance = history.performance[i];
+		const float threat = rng.FRand();
+		health = FMath::Max(0, health - (performance ? 0 : FAILURE_DAMAGE));
+		time += rng.RandRange(5, 30);
+		const int recommendation = threat > 0.5f ? 1 : 0;
+		// Followed with the probability of the reported trust
+		const bool followed = rng.FRand() * 100.f < history.trust_feedback[i];
+
+		columns.house_numbers.Add(i + 1);
+		columns.health_points.Add(health);
+		columns.time_points.Add(time);
+		columns.recommendations.Add(recommendation);
+		columns.actions.Add(followed ? recommendation : 1 - recommendation);
+		columns.trust_feedback.Add(history.trust_feedback[i]);
+		columns.original_estimates.Add(history.trust_feedback[i] / 100.f);
+		columns.performance_history.Add(performance);
+		columns.threat_levels.Add(threat);
+	}
+}
+
+bool WriteParticipantColumns(const participant_columns& columns, const FString& filepath)
+{
+	FString _data = header;
+	_data += LINE_TERMINATOR;
+	_data.Reserve(columns.Num() * 64);
+
+	for (int i = 0; i < columns.Num(); i++)
+	{
+		// Fields in Data.csv column order, 0 in the columns the reader skips
+		const FString fields[NUM_COLS] = {
+			FString::FromInt(columns.house_numbers[i]), "0", "0", "0", "0", "0", "0",
+			FString::FromInt(columns.health_points[i]), "0",
+			FString::FromInt(columns.time_points[i]), "0",
+			FString::FromInt(columns.recommendations[i]),
+			FString::FromInt(columns.trust_feedback[i]),
+			FString::SanitizeFloat(columns.original_estimates[i]),
+			FString::FromInt(columns.performance_history[i]),
+			FString::FromInt(columns.actions[i]),
+			FString::SanitizeFloat(columns.threat_levels[i])
+		};
+		for (int c = 0; c < NUM_COLS; c++)
+		{
+			if (c > 0) _data += ",";
+			_data += fields[c];
+		}
+		_data += LINE_TERMINATOR;
+	}
+	return FFileHelper::SaveStringToFile(_data, *filepath);
+}
+
+int32 WriteSyntheticStudy(const trust_synthetic_config& config, const FString& root, const FString& mode_name, int mission,
+						  bool overwrite)
+{
+	const FString mission_dir = "Mission" + FString::FromInt(mission);
+	const int32 J = FMath::Max(config.num_participants, 0);
+	auto data_path = [&](int32 j) { return FPaths::Combine(root, participant_dir(j + 1), mode_name, mission_dir, TEXT("Data.csv")); };
+
+	// Recorded sessions live in the same layout, never replace one
+	if (!overwrite)
+	{
+		for (int32 j = 0; j < J; j++)
+		{
+			if (IFileManager::Get().FileExists(*data_path(j))) return -1;
+		}
+	}
+
+	TArray<uint8> written;
+	written.SetNumZeroed(J);
+
+	// Each participant is generated, written and dropped by one task
+	ParallelFor(J, [&](int32 j)
+	{
+		double x[4];
+		trust_history history;
+		trust_synthesize(config, j, x, history);
+
+		participant_columns columns;
+		MakeSyntheticColumns(history, columns_seed(config, j), columns);
+		written[j] = WriteParticipantColumns(columns, data_path(j)) ? 1 : 0;
+	});
+
+	int32 num_written = 0;
+	for (uint8 ok : written) num_written += ok;
+	return num_written;
+}
+
+void AppendSyntheticStudy(const trust_synthetic_config& config, study_table& table, int mode, int mission)
+{
+	const int32 J = FMath::Max(config.num_participants, 0);
+	TArray<participant_columns> columns;
+	columns.SetNum(J);
+	ParallelFor(J, [&](int32 j)
+	{
+		double x[4];
+		trust_history history;
+		trust_synthesize(config, j, x, history);
+		MakeSyntheticColumns(history, columns_seed(config, j), columns[j]);
+	});
+
+	for (int32 j = 0; j < J; j++)
+	{
+		table.Append(j + 1, mission, mode, columns[j]);
+	}
+}
@@ -0,0 +1,57 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GenericPlatform/GenericPlatformFile.h"
+#include "ParticipantColumns.h"
+#include <functional>
+
+struct z_stream_s;
+
+// Sequential reader of a plain or gzip-compressed file. Compressed input
+// (detected by the gzip magic, concatenated members included) is inflated
+// a chunk at a time into the caller's buffer, never to disk.
+class CSVDATAREADER_API participant_file_stream
+{
+public:
+	static const int32 CHUNK_BYTES = 64 * 1024;
+
+	participant_file_stream();
+	~participant_file_stream();
+
+	bool Open(const FString& filepath);
+	void Close();
+	bool IsCompressed() const { return _z != nullptr; }
+	// A Read returned -1, the content is incomplete
+	bool HasFailed() const { return _failed; }
+
+	// Up to num bytes of (decompressed) content, 0 at the end, -1 on error,
+	// including a compressed file that ends before its last member does
+	int32 Read(uint8* out, int32 num);
+
+	// Exactly num bytes, false if the stream ends first
+	bool ReadExact(uint8* out, int32 num);
+	bool Skip(int64 num);
+
+private:
+	bool Refill();
+
+	TUniquePtr<IFileHandle> _file;
+	int64 _remaining;
+	z_stream_s* _z;
+	TArray<uint8> _in;
+	int32 _in_pos;
+	bool _member_done;
+	bool _failed;
+};
+
+// Parse a whole stream of Data.csv content into columns
+CSVDATAREADER_API bool ParseParticipantStream(participant_file_stream& stream, int64 num_bytes, participant_columns& columns);
+
+// Parse the Data.csv files of a tar archive (itself optionally gzipped),
+// streaming each entry into the parser, and hand each one to on_file with
+// its path inside the archive. Returns the number of files parsed, or -1
+// if the archive cannot be read or is cut short.
+CSVDATAREADER_API int32 ForEachArchivedParticipant(const FString& archive_path,
+	const std::function<void(const FString& path, participant_columns_ptr columns)>& on_file);
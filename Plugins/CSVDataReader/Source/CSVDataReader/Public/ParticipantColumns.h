@@ -0,0 +1,61 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Parsed columns of one participant data file. Immutable once loaded, and
+// shared by every actor that loads the same file.
+struct CSVDATAREADER_API participant_columns
+{
+	TArray<int> house_numbers;
+	TArray<int> health_points;
+	TArray<int> time_points;
+	TArray<int> recommendations;
+	// What the participant did, on the same scale as the recommendation
+	TArray<int> actions;
+	TArray<int> trust_feedback;
+	TArray<float> original_estimates;
+	TArray<int> performance_history;
+	TArray<float> threat_levels;
+
+	int Num() const { return trust_feedback.Num(); }
+	SIZE_T GetAllocatedSize() const;
+
+	// Parse the text of a data file (header line first)
+	void Parse(const FString& text);
+
+	// Append the site of one data line [begin, end), returns false for
+	// lines with too few fields
+	template <typename CharType>
+	bool AddLine(const CharType* begin, const CharType* end);
+};
+
+// Incremental parse of a data file that is still being written. Fed the
+// bytes appended since the last feed, it parses the complete lines and
+// keeps a trailing partial line until its newline arrives, so each feed
+// costs O(new bytes).
+struct CSVDATAREADER_API participant_tail_parser
+{
+	// Bytes of the file consumed so far
+	int64 offset = 0;
+	bool header_done = false;
+	TArray<ANSICHAR> carry;
+
+	// Returns the number of sites appended to columns
+	int32 Feed(const ANSICHAR* bytes, int32 num, participant_columns& columns);
+
+	// At the end of a complete file, parse a last line that has no newline
+	int32 Finish(participant_columns& columns);
+	void Reset();
+};
+
+typedef TSharedPtr<const participant_columns, ESPMode::ThreadSafe> participant_columns_ptr;
+
+// Columns of the file at filepath. If another actor still holds this file's
+// columns, and the file's size and modification time are those it was
+// loaded with, they are shared. Otherwise the file is read and parsed; the file
+// text only lives for the duration of the parse. Gzipped files (.gz) are
+// inflated as they are parsed. Returns null if the file cannot be read.
+// Entries expire with their last holder.
+CSVDATAREADER_API participant_columns_ptr LoadParticipantColumns(const FString& filepath);
@@ -4,8 +4,13 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "GenericPlatform/GenericPlatformFile.h"
+#include "ParticipantColumns.h"
 #include "ParticipantSimulator.generated.h"
 
+struct trust_history;
+class AOptimizer;
+
 UCLASS()
 class CSVDATAREADER_API AParticipantSimulator : public AActor
 {
@@ -27,11 +32,16 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void SetSelectorData(int pid, int mission_num, int interaction_mode);
 
+	// Read from and write to dir in place of the directory SetSelectorData
+	// selects, e.g. a generated study outside the project's CSV directory
+	void SetDataDirectory(const FString& dir);
+
 	// Reads the data from the file and converts it into arrays
 	UFUNCTION(BlueprintCallable)
 	bool ReadData();
 
-	// Gets one line of data needed for the parameter updater
+	// Gets one line of data needed for the parameter updater, both 0 if
+	// no data is loaded or site_idx is out of range
 	UFUNCTION(BlueprintCallable)
 	void GetData(int site_idx, int& performance, int& trust_feedback);
 
@@ -39,9 +49,76 @@ public:
 	UPROPERTY(BlueprintReadOnly)
 	int num_sites;
 
+	// Whole columns in one call, in place of num_sites GetData calls
+	UFUNCTION(BlueprintCallable)
+	void GetColumns(TArray<int>& performance, TArray<int>& trust_feedback, TArray<float>& threat_levels,
+					TArray<int>& health_points, TArray<int>& time_points, TArray<int>& recommendations) const;
+
+	// Read-only views of the loaded columns, empty before ReadData
+	TArrayView<const int> GetPerformanceView() const;
+	TArrayView<const int> GetTrustFeedbackView() const;
+	TArrayView<const float> GetThreatLevelView() const;
+	TArrayView<const int> GetHealthView() const;
+	TArrayView<const int> GetTimeView() const;
+	TArrayView<const int> GetRecommendationView() const;
+
+	// Follow Data.csv while a session logger appends to it. The rows
+	// already in the file are read first, then each PollFollow parses only
+	// the complete rows appended since the last poll and posts their sites
+	// to optimizer (AOptimizer::PostEvent), if one is given. A file that
+	// shrinks was truncated or replaced, and is followed again from its
+	// start, with the optimizer reset. Returns false if the file cannot be
+	// opened. ReadData stops following.
+	UFUNCTION(BlueprintCallable)
+	bool StartFollow(AOptimizer* optimizer);
+
+	// Returns the number of new sites
+	UFUNCTION(BlueprintCallable)
+	int PollFollow();
+
+	// Parses a last row that has no newline yet, then stops following
+	UFUNCTION(BlueprintCallable)
+	void StopFollow();
+
+	// Replay the loaded history through the optimizer's online update in
+	// one native call, estimates[i] being the trust estimate after site i
+	UFUNCTION(BlueprintCallable)
+	bool ReplayEstimates(AOptimizer* optimizer, TArray<float>& estimates) const;
+
 	UFUNCTION(BlueprintCallable)
 	bool WriteTrustEstimates(const TArray<float>& new_estimates);
 
+	// Copy the loaded performance / trust feedback columns
+	void GetHistory(trust_history& history) const;
+
+	// k-fold cross-validation of the trust estimate over the loaded
+	// participants (num_folds = 0 for leave-one-out). Outputs the held-out
+	// log-likelihood and RMSE per participant and over the study.
+	UFUNCTION(BlueprintCallable)
+	static bool CrossValidate(const TArray<AParticipantSimulator*>& participants, int num_folds,
+							  TArray<float>& log_likelihood, TArray<float>& rmse,
+							  float& total_log_likelihood, float& total_rmse);
+
+	// Replay the loaded participants under a grid of solver profiles and
+	// write every profile's deviation from a converged fit, and the latency
+	// of the ones that passed screening, to output_file (CSV, timed and
+	// Pareto-optimal rows flagged). The recommended
+	// profile is logged and its figures returned.
+	UFUNCTION(BlueprintCallable)
+	static bool TuneProfile(const TArray<AParticipantSimulator*>& participants, const FString& output_file,
+							float& latency_us, float& deviation);
+
+	// Write a synthetic study drawn from the trust model with the given
+	// ground truth, num_participants histories of num_sites sites, to
+	// root (Saved/SyntheticStudy if empty) in the layout ReadData reads,
+	// under the given interaction mode and mission. The same seed always
+	// writes the same files. Existing Data.csv files are never replaced:
+	// if any is in the way nothing is written. Returns the number of files
+	// written.
+	UFUNCTION(BlueprintCallable)
+	static int GenerateStudy(const FString& root, float alpha0, float beta0, float ws, float wf,
+							 int num_participants, int num_sites, int interaction_mode, int mission_num, int seed);
+
 
 private:
 	// Data needed for selecting the file
@@ -55,20 +132,18 @@ private:
 	// Set the base directory of the data files
 	void SetDirectory();
 
-	// Convert the file data string to desired arrays
-	void ConvertDataToArrays();
-
-	// Data to read
-	TArray<int> house_numbers;
-	TArray<int> health_points;
-	TArray<int> time_points;
-	TArray<int> recommendations;
-	TArray<int> _trust_feedback;
-	TArray<float> original_estimates;
-	TArray<int> performance_history;
-	TArray<float> threat_levels;
-	FString data;
-	TArray<FString> lines;
+	// Data read from the file, shared with actors that read the same file
+	participant_columns_ptr _columns;
+
+	// Follow mode: columns owned by this actor and grown in place. Views
+	// handed out earlier may be invalidated by a poll.
+	TSharedPtr<participant_columns, ESPMode::ThreadSafe> _follow_columns;
+	TUniquePtr<IFileHandle> _follow_file;
+	participant_tail_parser _follow_parser;
+	TWeakObjectPtr<AOptimizer> _follow_optimizer;
+
+	// Update num_sites and post the followed sites from first on
+	void PostFollowedSites(int first);
 
 	void reset();
 };
@@ -0,0 +1,102 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ParticipantColumns.h"
+#include <vector>
+
+struct trust_history;
+
+enum class study_column : uint8
+{
+	participant,
+	mission,
+	mode,
+	site,
+	house,
+	health,
+	time,
+	recommendation,
+	action,
+	trust_feedback,
+	original_estimate,
+	performance,
+	threat_level,
+	count
+};
+
+enum class study_op : uint8 { lt, le, eq, ne, ge, gt };
+
+// column op value, or column op other when other is set, e.g.
+// { action, ne, 0, recommendation } for the sites where the recommendation
+// was ignored
+struct study_predicate
+{
+	study_column column;
+	study_op op;
+	double value;
+	study_column other = study_column::count;
+};
+
+// Every site of a study in one set of columns, a row per site. Rows are
+// grouped in zones of ZONE_ROWS with the min / max of each column, so a
+// scan skips zones no row of which can match, takes zones all rows of
+// which match without looking at them, and only scans the rest. Queries
+// return a selection vector of row indices, in row order, which
+// GetHistories and WriteCSV consume directly.
+class CSVDATAREADER_API study_table
+{
+public:
+	static const int32 ZONE_ROWS = 1024;
+
+	// Load every <root>/ParticipantNNN/<mode>/MissionM/Data.csv below root
+	// (or Data.csv.gz), returns the number of files loaded
+	int32 LoadStudy(const FString& root);
+
+	// Load the Data.csv files of a tar archive of a study (.tar or .tar.gz)
+	// with the same layout, streamed without extracting to disk; returns
+	// the number of files loaded, or -1 if the archive cannot be read or
+	// is cut short, the files before the damage staying loaded
+	int32 LoadArchive(const FString& archive_path);
+
+	// Append one file's sites
+	void Append(int pid, int mission, int mode, const participant_columns& columns);
+
+	void Empty();
+	int32 Num() const { return _num_rows; }
+
+	// Rows matching all predicates. Returns false, with an empty selection,
+	// if a predicate names a column the table does not have.
+	bool Select(const TArray<study_predicate>& predicates, TArray<int32>& selection) const;
+
+	double Get(study_column column, int32 row) const;
+
+	// The selected rows of each (participant, mission, mode) in row order,
+	// one history per run of adjacent rows from the same file. Where the
+	// selection skips rows, a new history starts, and the success and
+	// failure counts of a fit restart there: the skipped sites are not
+	// counted towards the later ones.
+	void GetHistories(const TArray<int32>& selection, std::vector<trust_history>& histories) const;
+
+	// Write the selected rows with all columns
+	bool WriteCSV(const TArray<int32>& selection, const FString& filepath) const;
+
+private:
+	// Columns are stored by type, integer ones as int32
+	static bool IsFloat(study_column column)
+	{
+		return column == study_column::original_estimate || column == study_column::threat_level;
+	}
+
+	TArray<int32> _ints[(int)study_column::count];
+	TArray<float> _floats[(int)study_column::count];
+	TArray<double> _zone_min[(int)study_column::count];
+	TArray<double> _zone_max[(int)study_column::count];
+	int32 _num_rows = 0;
+
+	// Append a file's sites, identified by its .../ParticipantNNN/<mode>/MissionM/Data.csv path
+	void AppendFile(const FString& filepath, const participant_columns& columns);
+	void ExtendZones(int32 first_row);
+	void ScanZone(const study_predicate& predicate, int32 begin, int32 end, uint8* mask) const;
+};
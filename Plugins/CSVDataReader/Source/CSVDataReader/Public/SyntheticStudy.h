@@ -0,0 +1,30 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ParticipantColumns.h"
+#include "TrustSynthetic.h"
+
+class study_table;
+
+// Columns of a synthetic participant. Performance and trust feedback come
+// from the history; the columns the trust model does not read are filled
+// with values of the right type and range, drawn from seed.
+CSVDATAREADER_API void MakeSyntheticColumns(const trust_history& history, uint32 seed, participant_columns& columns);
+
+// Write columns as a Data.csv, header line first, in the 17-column layout
+// participant_columns::Parse reads
+CSVDATAREADER_API bool WriteParticipantColumns(const participant_columns& columns, const FString& filepath);
+
+// Write participant j of the study as
+// <root>/Participant0NN/<mode_name>/Mission<mission>/Data.csv, NN = j + 1,
+// the layout AParticipantSimulator and study_table::LoadStudy read. Files
+// are generated and written in parallel. Returns the number written, or
+// -1, writing nothing, if one of the files exists and overwrite is false.
+CSVDATAREADER_API int32 WriteSyntheticStudy(const trust_synthetic_config& config, const FString& root,
+											const FString& mode_name = TEXT("Constant"), int mission = 1,
+											bool overwrite = false);
+
+// Append the study to table without touching the disk
+CSVDATAREADER_API void AppendSyntheticStudy(const trust_synthetic_config& config, study_table& table, int mode = 0, int mission = 1);
@@ -239,6 +239,41 @@ namespace nlopt {
       return HUGE_VAL;
     }
 
+    // nlopt_func wrapper, instantiated once per functor type F so that the
+    // call to F::operator() is resolved at compile time and can be inlined;
+    // N > 0 fixes the dimension at compile time (the functor sees n == N)
+    template <typename F, unsigned N>
+    static double typed_wrapper(unsigned n, const double *x,
+                                double *grad, void *d_) {
+      myfunc_data *d = reinterpret_cast<myfunc_data*>(d_);
+      try {
+        F &f = *static_cast<F*>(d->f_data);
+        return f(N ? N : n, x, grad);
+      }
+      catch (std::bad_alloc&)
+	{ d->o->forced_stop_reason = NLOPT_OUT_OF_MEMORY; }
+      catch (std::invalid_argument&)
+	{ d->o->forced_stop_reason = NLOPT_INVALID_ARGS; }
+      catch (roundoff_limited&)
+	{ d->o->forced_stop_reason = NLOPT_ROUNDOFF_LIMITED; }
+      catch (forced_stop&)
+	{ d->o->forced_stop_reason = NLOPT_FORCED_STOP; }
+      catch (...)
+	{ d->o->forced_stop_reason = NLOPT_FAILURE; }
+      d->o->force_stop(); // stop gracefully, opt::optimize will re-throw
+      return HUGE_VAL;
+    }
+
+
+    template <unsigned N, typename F>
+    myfunc_data *alloc_typed_myfunc_data(F &f) {
+      if (N && o && nlopt_get_dimension(o) != N)
+        throw std::invalid_argument("dimension mismatch");
+      myfunc_data *d = alloc_and_init_myfunc_data();
+      d->f_data = static_cast<void*>(&f);
+      return d;
+    }
+
     void alloc_tmp() {
       if (xtmp.size() != nlopt_get_dimension(o)) {
 	xtmp = std::vector<double>(nlopt_get_dimension(o));
@@ -250,6 +285,9 @@ namespace nlopt {
     result last_result;
     double last_optf;
     nlopt_result forced_stop_reason;
+    // per-object random stream, see set_rand_seed
+    bool rand_seeded = false;
+    unsigned long rand_seed = 0, rand_runs = 0;
 
   public:
     // Constructors etc.
@@ -280,7 +318,9 @@ namespace nlopt {
 			xtmp(f.xtmp), gradtmp(f.gradtmp), gradtmp0(0),
 			exceptions_enabled(f.exceptions_enabled),
 			last_result(f.last_result), last_optf(f.last_optf),
-			forced_stop_reason(f.forced_stop_reason) {
+			forced_stop_reason(f.forced_stop_reason),
+			rand_seeded(f.rand_seeded), rand_seed(f.rand_seed),
+			rand_runs(f.rand_runs) {
       if (f.o && !o) throw std::bad_alloc();
     }
     opt& operator=(opt const& f) {
@@ -292,6 +332,8 @@ namespace nlopt {
       exceptions_enabled = f.exceptions_enabled;
       last_result = f.last_result; last_optf = f.last_optf;
       forced_stop_reason = f.forced_stop_reason;
+      rand_seeded = f.rand_seeded; rand_seed = f.rand_seed;
+      rand_runs = f.rand_runs;
       return *this;
     }
 
@@ -300,6 +342,8 @@ namespace nlopt {
       if (o && nlopt_get_dimension(o) != x.size())
         throw std::invalid_argument("dimension mismatch");
       forced_stop_reason = NLOPT_FORCED_STOP;
+      if (rand_seeded) // fixed golden-ratio stride between runs
+        nlopt_srand(rand_seed + 0x9e3779b9UL * rand_runs++);
       nlopt_result ret = nlopt_optimize(o, x.empty() ? NULL : &x[0], &opt_f);
       last_result = result(ret);
       last_optf = opt_f;
@@ -318,6 +362,7 @@ namespace nlopt {
       return x;
     }
     result last_optimize_result() const { return last_result; }
+
     double last_optimum_value() const { return last_optf; }
 
     // accessors:
@@ -379,6 +424,23 @@ namespace nlopt {
       mythrow(nlopt_set_max_objective(o, functor_wrapper, d)); // d freed via o
     }
 
+    // typed objectives: f is any callable with the signature
+    //    double operator()(unsigned n, const double *x, double *grad);
+    // it is held by reference (it must outlive optimize) and called through
+    // a per-type wrapper, without vfunc copies or std::function dispatch.
+    // e.g. opt.set_max_objective_typed<4>(f) for a 4-dimensional problem.
+    template <unsigned N = 0, typename F>
+    void set_min_objective_typed(F &f) {
+      myfunc_data *d = alloc_typed_myfunc_data<N>(f);
+      mythrow(nlopt_set_min_objective(o, typed_wrapper<F, N>, d)); // d freed via o
+    }
+    template <unsigned N = 0, typename F>
+    void set_max_objective_typed(F &f) {
+      myfunc_data *d = alloc_typed_myfunc_data<N>(f);
+      mythrow(nlopt_set_max_objective(o, typed_wrapper<F, N>, d)); // d freed via o
+    }
+
+
     // for internal use in SWIG wrappers -- variant that
     // takes ownership of f_data, with munging for destroy/copy
     void set_min_objective(func f, void *f_data,
@@ -582,6 +644,20 @@ namespace nlopt {
 
     NLOPT_GETSET(unsigned, population)
     NLOPT_GETSET(unsigned, vector_storage)
+    // per-object random stream for the stochastic algorithms: once seeded,
+    // every optimize reseeds the calling thread's generator (nlopt_srand)
+    // from the seed and the number of earlier runs of this object.  Copies
+    // continue the stream from where the original was.
+    // This reseeding, together with the generator being thread-local in the
+    // shipped nlopt library, is all that keeps concurrent stochastic runs
+    // reproducible; nothing else is made thread safe.  In particular the
+    // defaults of the deprecated global API (nlopt_set_local_search_algorithm,
+    // nlopt_set_stochastic_population) are still read by every optimize, so
+    // they must not be changed while optimizations run.
+    void set_rand_seed(unsigned long seed) {
+      rand_seeded = true; rand_seed = seed; rand_runs = 0;
+    }
+    unsigned long get_rand_seed() const { return rand_seed; }
     NLOPT_GETSET_VEC(initial_step)
 
     void set_default_initial_step(const std::vector<double> &x) {
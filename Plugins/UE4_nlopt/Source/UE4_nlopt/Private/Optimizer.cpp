@@ -2,6 +2,8 @@
 
 
 #include "Optimizer.h"
+#include "TrustEstimationSubsystem.h"
+#include "TrustFitCache.h"
 #include <boost/math/special_functions/digamma.hpp>
 #include <boost/math/special_functions/gamma.hpp>
 #include <boost/math_fwd.hpp>
@@ -11,8 +13,21 @@
 AOptimizer::AOptimizer()
 {
  	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = false;
-	MAX_EVAL = 10;
+	// Ticking is only switched on while a time-sliced update is running.
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = false;
+	MAX_EVAL = _profile.max_evals;
+	_opt_ready = false;
+	_has_prior = false;
+	_history_hash = TRUST_HASH_EMPTY;
+	_has_estimate = false;
+	_logl = 0.;
+	_numevals = 0;
+	for (int k = 0; k < 4; k++) _x[k] = 0.;
+	use_fit_cache = true;
+	frame_budget_us = 500.f;
+	solve_in_progress = false;
+	alpha0_best = beta0_best = ws_best = wf_best = 0.f;
 }
 
 // Called when the game starts or when spawned
@@ -27,199 +42,367 @@ void AOptimizer::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
+	// Continue the time-sliced update and publish its best point
+	if (solve_in_progress)
+	{
+		const bool done = _solver.run(frame_budget_us);
+		PublishBest();
+		if (done)
+		{
+			SetEstimate(_solver.best_x(), _solver.best_logl(), _solver.get_numevals());
+			StopTimeSlicedUpdate();
+		}
+	}
 }
 
 
-double Objective(const std::vector<double> &x, std::vector<double> &grad, void* func_data)
-{
-	double _alpha0 = x[0];
-	double _beta0 = x[1];
-	double _ws = x[2];
-	double _wf = x[3];
-	double logl = 0.f;
-
-	double alpha = _alpha0;
-	double beta = _beta0;
-	int ns = 0, nf = 0;
-
-	feedback_data* data = reinterpret_cast<feedback_data*>(func_data);
-	std::vector<int> performance_history = data->performance;
-	std::vector<int> _trust_feedback = data->trust_feedback;
-	nlopt::opt opt = data->_opt;
-	int max_evals = data->_max_evals;
-	if (opt.get_numevals() >= max_evals)
-	{
-		opt.force_stop();
-	}
-
-	/*if (_trust_feedback.size() == 7)
-		GEngine->AddOnScreenDebugMessage(-1, 10.f, FColor::Yellow, FString::Printf(TEXT("Performance: %d, Feedback: %d"), performance_history.back(), _trust_feedback.back()));*/
-
-	for (int i = 0; i < performance_history.size(); i++)
-	{
-		int p = performance_history[i];
-		double t = (double)_trust_feedback[i] / 100.;
-		if (t < 0.01) t = 0.01;
-		if (t > 0.99) t = 0.99;
-		ns += p;
-		nf += (1 - p);
-		alpha += p * _ws;
-		beta += (1 - p) * _wf;
-		double logt = (double) FMath::Loge(t);
-		double log1t = (double) FMath::Loge(1. - t);
-		logl += boost::math::lgamma(alpha + beta) - boost::math::lgamma(alpha) - boost::math::lgamma(beta);
-		logl += (alpha - 1) * logt + (beta - 1) * log1t;
-
-		double digamma_both = boost::math::digamma(alpha + beta);
-		double digamma_alpha = boost::math::digamma(alpha);
-		double digamma_beta = boost::math::digamma(beta);
-
-		grad[0] += (digamma_both - digamma_alpha + logt);
-		grad[1] += (digamma_both - digamma_beta + log1t);
-		grad[2] += (digamma_both - digamma_alpha + logt) * ns;
-		grad[3] += (digamma_both - digamma_beta + log1t) * nf;
-	}
-
-	/*if (_trust_feedback.size() == 7) {
-		FString out = FString::Printf(TEXT("grad[0]: %.2f, grad[1]: %.2f, grad[2]: %.2f, grad[3]: %.2f"), grad[0], grad[1], grad[2], grad[3]);
-		GEngine->AddOnScreenDebugMessage(-1, 10.f, FColor::Yellow, out);
-	}*/
-
-	return logl;
-}
-
-
-//double AOptimizer::Objective(const std::vector<double>& x, std::vector<double>& grad, void* func_data)
-//{
-//	float _alpha0 = x[0];
-//	float _beta0 = x[1];
-//	float _ws = x[2];
-//	float _wf = x[3];
-//	float logl = 0.f;
-//
-//	float alpha = _alpha0;
-//	float beta = _beta0;
-//	int ns = 0, nf = 0;
-//
-//	for (int i = 0; i < performance_history.size(); i++)
-//	{
-//		int p = performance_history[i];
-//		float t = (float)_trust_feedback[i] / 100.f;
-//		if (t < 0.01) t = 0.01f;
-//		if (t > 0.99) t = 0.99f;
-//		ns += p;
-//		nf += p;
-//		alpha += p * _ws;
-//		beta += (1 - p) * _wf;
-//		float logt = FMath::Loge(t);
-//		float log1t = FMath::Loge(1.f - t);
-//		logl += boost::math::lgamma(alpha + beta) - boost::math::lgamma(alpha) - boost::math::lgamma(beta);
-//		logl += (alpha - 1) * logt + (beta - 1) * log1t;
-//
-//		float digamma_both = boost::math::digamma(alpha + beta);
-//		float digamma_alpha = boost::math::digamma(alpha);
-//		float digamma_beta = boost::math::digamma(beta);
-//
-//		grad[0] += (digamma_both - digamma_alpha + logt);
-//		grad[1] += (digamma_both - digamma_beta + log1t);
-//		grad[2] += (digamma_both - digamma_alpha + logt) * ns;
-//		grad[3] += (digamma_both - digamma_beta + log1t) * nf;
-//	}
-//
-//	return -logl;
-//}
-
-
 void AOptimizer::UpdateParameters(int performance, int trust_feedback, float alpha0_last, float beta0_last, float ws_last, float wf_last,
 								  float& alpha0, float& beta0, float& ws, float& wf)
 {
 	// Add the data
-	performance_history.push_back(performance);
-	_trust_feedback.push_back(trust_feedback);
+	AddSample(performance, trust_feedback);
 
-	if (performance_history.size() < 2)
+	if (history.size() < 2)
 	{
 		GetInitialGuess(trust_feedback, alpha0, beta0, ws, wf);
 		return;
 	}
-	
-	// Setup the optimizer
-	nlopt::opt opt(nlopt::LD_LBFGS, 4);
-
-	// Set the lower bounds
-	std::vector<double> lb = { 1., 1., 0.1, 0.1 };
-	opt.set_lower_bounds(lb);
-
-	// Set the upper bounds
-	std::vector<double> ub = { 200., 200., 200., 200. };
-	opt.set_upper_bounds(ub);
-
-	// Stopping criteria
-	opt.set_maxeval(15);
-	opt.set_xtol_rel(1e-1);
-	opt.set_ftol_rel(1e-1);
-	opt.set_ftol_abs(1e-4);
-	//opt.set_xtol_abs(1e-4);
-	
+
+	Solve(alpha0_last, beta0_last, ws_last, wf_last, alpha0, beta0, ws, wf);
+}
+
+FTrustEstimate AOptimizer::Update(int performance, int trust_feedback)
+{
+	AddSample(performance, trust_feedback);
+
+	// The first observation only sets the initial guess
+	if (!_has_estimate)
+	{
+		float guess[4];
+		GetInitialGuess(trust_feedback, guess[0], guess[1], guess[2], guess[3]);
+		const double x[4] = { guess[0], guess[1], guess[2], guess[3] };
+		SetEstimate(x, 0., 0);
+	}
+
+	if (history.size() >= 2)
+	{
+		std::vector<double> x0(_x, _x + 4);
+		SolveFrom(x0);
+	}
+	return GetEstimate();
+}
+
+FTrustEstimate AOptimizer::GetEstimate() const
+{
+	FTrustEstimate estimate;
+	if (!_has_estimate) return estimate;
+
+	const int ns = history.successes();
+	const int nf = static_cast<int>(history.size()) - ns;
+	const double alpha = _x[0] + ns * _x[2];
+	const double beta = _x[1] + nf * _x[3];
+
+	estimate.alpha0 = static_cast<float> (_x[0]);
+	estimate.beta0 = static_cast<float> (_x[1]);
+	estimate.ws = static_cast<float> (_x[2]);
+	estimate.wf = static_cast<float> (_x[3]);
+	estimate.trust = static_cast<float> (alpha / (alpha + beta));
+	estimate.log_likelihood = static_cast<float> (_logl);
+	estimate.num_evals = _numevals;
+	estimate.num_sites = static_cast<int32> (history.size());
+	estimate.valid = true;
+	return estimate;
+}
+
+void AOptimizer::GetGradient(double grad[4]) const
+{
+	for (int k = 0; k < 4; k++) grad[k] = 0.;
+	if (!_has_estimate || history.empty()) return;
+
+	trust_objective objective;
+	objective.history = &history;
+	objective(4, _x, grad);
+}
+
+void AOptimizer::RequestUpdate(int performance, int trust_feedback, float alpha0_last, float beta0_last, float ws_last, float wf_last)
+{
+	UWorld* world = GetWorld();
+	UTrustEstimationSubsystem* scheduler = world ? world->GetSubsystem<UTrustEstimationSubsystem>() : nullptr;
+	if (scheduler)
+	{
+		scheduler->Submit(this, performance, trust_feedback, alpha0_last, beta0_last, ws_last, wf_last);
+		return;
+	}
+
+	// No scheduler, solve right away
+	UpdateParameters(performance, trust_feedback, alpha0_last, beta0_last, ws_last, wf_last,
+					 alpha0_best, beta0_best, ws_best, wf_best);
+}
+
+void AOptimizer::AddSample(int performance, int trust_feedback)
+{
+	history.push_back(performance, trust_feedback);
+	_history_hash = trust_hash_site(_history_hash, performance, trust_feedback);
+}
+
+void AOptimizer::AddSamples(TArrayView<const int> performance, TArrayView<const int> trust_feedback)
+{
+	const int num = FMath::Min(performance.Num(), trust_feedback.Num());
+	history.reserve(history.size() + num);
+	for (int i = 0; i < num; i++)
+	{
+		AddSample(performance[i], trust_feedback[i]);
+	}
+}
+
+void AOptimizer::Replay(TArrayView<const int> performance, TArrayView<const int> trust_feedback, TArray<float>& estimates)
+{
+	reset();
+	const int num = FMath::Min(performance.Num(), trust_feedback.Num());
+	history.reserve(num);
+	estimates.SetNumUninitialized(num);
+
+	for (int i = 0; i < num; i++)
+	{
+		estimates[i] = Update(performance[i], trust_feedback[i]).trust;
+	}
+}
+
+void AOptimizer::PostEvent(int performance, int trust_feedback)
+{
+	// Lock-free while the preallocated nodes last, then allocates
+	_events.push(trust_event{ performance, trust_feedback });
+}
+
+int AOptimizer::DrainEvents()
+{
+	return static_cast<int>(_events.consume_all([this](const trust_event& e)
+	{
+		AddSample(e.performance, e.trust_feedback);
+	}));
+}
+
+bool AOptimizer::UpdateFromEvents(float alpha0_last, float beta0_last, float ws_last, float wf_last,
+								  float& alpha0, float& beta0, float& ws, float& wf)
+{
+	if (DrainEvents() == 0) return false;
+
+	if (history.size() < 2)
+	{
+		GetInitialGuess(history.last_feedback(), alpha0, beta0, ws, wf);
+		return true;
+	}
+
+	// One refit for the whole batch
+	Solve(alpha0_last, beta0_last, ws_last, wf_last, alpha0, beta0, ws, wf);
+	return true;
+}
+
+void AOptimizer::Solve(float alpha0_last, float beta0_last, float ws_last, float wf_last,
+					   float& alpha0, float& beta0, float& ws, float& wf)
+{
 	// Choose an initial guess
-	std::vector<double> x0 = { alpha0_last, beta0_last, ws_last, wf_last };
-	
-	// Add the external data
-	feedback_data data;
-	data.performance = performance_history;
-	data.trust_feedback = _trust_feedback;
-	data._opt = opt;
-	data._max_evals = MAX_EVAL;
+	std::vector<double> x0(4);
+	WarmStart(alpha0_last, beta0_last, ws_last, wf_last, x0.data());
+
+	SolveFrom(x0);
+	alpha0 = static_cast<float> (_x[0]);
+	beta0 = static_cast<float> (_x[1]);
+	ws = static_cast<float> (_x[2]);
+	wf = static_cast<float> (_x[3]);
+}
+
+void AOptimizer::WarmStart(float alpha0_last, float beta0_last, float ws_last, float wf_last, double x0[4]) const
+{
+	const float last[4] = { alpha0_last, beta0_last, ws_last, wf_last };
+	bool stored = _has_estimate;
+	for (int k = 0; k < 4 && stored; k++)
+	{
+		stored = static_cast<float> (_x[k]) == last[k];
+	}
+	for (int k = 0; k < 4; k++)
+	{
+		x0[k] = stored ? _x[k] : last[k];
+	}
+}
+
+void AOptimizer::SolveFrom(std::vector<double>& x0)
+{
+	// Setup the optimizer on first use, later updates rerun it
+	if (!_opt_ready)
+	{
+		SetupOptimizer();
+	}
+	_objective._max_evals = MAX_EVAL;
+
+	// The same history, start and settings always give the same fit
+	uint64 key = 0;
+	if (use_fit_cache)
+	{
+		trust_profile profile = _profile;
+		profile.max_evals = MAX_EVAL;
+		key = trust_fit_key(_history_hash, x0.data(), profile);
+		double x[4], logl;
+		int numevals;
+		if (trust_fit_cache::shared().find(key, x, logl, numevals))
+		{
+			SetEstimate(x, logl, numevals);
+			return;
+		}
+	}
 
-	// Set the objective function
-	opt.set_max_objective(Objective, &data);
+	// Add a variable for the minimum function value, set even if the solve throws
+	double minf = 0.;
 
-	// Add a variable for the minimum function value
-	double minf;
+	// The reparameterized solve starts from and returns z
+	if (_profile.reparameterize) trust_to_unconstrained(x0.data());
 
 	try {
-		nlopt::result result = opt.optimize(x0, minf);
-		alpha0 = static_cast<float> (x0[0]);
-		beta0 = static_cast<float> (x0[1]);
-		ws = static_cast<float> (x0[2]);
-		wf = static_cast<float> (x0[3]);
+		_opt.optimize(x0, minf);
 		//GEngine->AddOnScreenDebugMessage(-1, 10.f, FColor::Green, FString::Printf(TEXT("Solved! Num Evals: %d"), opt.get_numevals()));
 	}
 	catch (...) {
-		alpha0 = static_cast<float> (x0[0]);
-		beta0 = static_cast<float> (x0[1]);
-		ws = static_cast<float> (x0[2]);
-		wf = static_cast<float> (x0[3]);
+		// Keep the last point
 		//FString out = FString::Printf(TEXT("%s, Num Evals: %d"), e.what(), opt.get_numevals());
 		//GEngine->AddOnScreenDebugMessage(-1, 10.f, FColor::Red, out);
+	}
+	if (_profile.reparameterize) trust_from_unconstrained(x0.data());
+	SetEstimate(x0.data(), minf, _opt.get_numevals());
 
+	if (use_fit_cache)
+	{
+		trust_fit_cache::shared().insert(key, x0.data(), _logl, _numevals);
 	}
 }
 
+void AOptimizer::SetEstimate(const double x[4], double logl, int numevals)
+{
+	for (int k = 0; k < 4; k++) _x[k] = x[k];
+	_has_estimate = true;
+	_logl = logl;
+	_numevals = numevals;
+}
 
-void AOptimizer::GetInitialGuess(int trust_feedback, float& alpha0, float& beta0, float& ws, float& wf)
+void AOptimizer::SetupOptimizer()
 {
-	ws = 1.f;
-	wf = 2.f;
-	alpha0 = trust_feedback;
-	if (alpha0 <= 1) alpha0 = 1.1;
-	if (alpha0 >= 99) alpha0 = 98.9;
-	beta0 = 100 - alpha0;
+	// Bounds and stopping criteria of the profile
+	_opt = trust_configure(_profile);
+
+	// Add the external data, read in place on every run
+	_objective.performance = nullptr;
+	_objective.trust_feedback = nullptr;
+	_objective.history = &history;
+	_objective._opt = &_opt;
+	_objective._max_evals = MAX_EVAL;
+
+	// Set the objective function, over z if the profile reparameterizes
+	trust_bind_objective(_opt, _profile, _objective, _reparameterized);
+
+	// Kept between updates, so a run only allocates inside nlopt_optimize
+	_opt_ready = true;
 }
 
-float AOptimizer::GetTrustEstimate(float alpha0, float beta0, float ws, float wf)
+void AOptimizer::StartTimeSlicedUpdate(int performance, int trust_feedback, float alpha0_last, float beta0_last, float ws_last, float wf_last)
+{
+	// Add the data
+	AddSample(performance, trust_feedback);
+
+	if (history.size() < 2)
+	{
+		StopTimeSlicedUpdate();
+		GetInitialGuess(trust_feedback, alpha0_best, beta0_best, ws_best, wf_best);
+		return;
+	}
+
+	// Same bounds and stopping criteria as UpdateParameters
+	_solver.set_bounds(trust_lb, trust_ub);
+	_solver.set_stopping(MAX_EVAL > 0 && MAX_EVAL < _profile.maxeval ? MAX_EVAL : _profile.maxeval,
+						 _profile.xtol_rel, _profile.ftol_rel, _profile.ftol_abs);
+
+	// Restart from the last estimate, a running solve is superseded
+	double x0[4];
+	WarmStart(alpha0_last, beta0_last, ws_last, wf_last, x0);
+	_solver.start(x0, &history);
+	PublishBest();
+
+	solve_in_progress = true;
+	SetActorTickEnabled(true);
+}
+
+void AOptimizer::PublishBest()
+{
+	const double* x = _solver.best_x();
+	alpha0_best = static_cast<float> (x[0]);
+	beta0_best = static_cast<float> (x[1]);
+	ws_best = static_cast<float> (x[2]);
+	wf_best = static_cast<float> (x[3]);
+}
+
+void AOptimizer::StopTimeSlicedUpdate()
+{
+	solve_in_progress = false;
+	SetActorTickEnabled(false);
+}
+
+void AOptimizer::SetProfile(const trust_profile& profile)
+{
+	_profile = profile;
+	MAX_EVAL = profile.max_evals;
+
+	// Reconfigured on the next update
+	_opt_ready = false;
+}
+
+void AOptimizer::SetPopulationPrior(float alpha0, float beta0, float ws, float wf)
+{
+	_prior[0] = alpha0;
+	_prior[1] = beta0;
+	_prior[2] = ws;
+	_prior[3] = wf;
+	_has_prior = true;
+}
+
+void AOptimizer::GetInitialGuess(int trust_feedback, float& alpha0, float& beta0, float& ws, float& wf)
 {
-	float alpha = alpha0, beta = beta0;
-	for (int p : performance_history)
+	if (_has_prior)
 	{
-		alpha += p * ws;
-		beta += (1 - p) * wf;
+		// Population weights and prior strength, split by the first feedback
+		ws = _prior[2];
+		wf = _prior[3];
+		const float strength = _prior[0] + _prior[1];
+		alpha0 = strength * FMath::Clamp(trust_feedback / 100.f, 0.01f, 0.99f);
+		beta0 = strength - alpha0;
+		if (alpha0 < 1.1f) alpha0 = 1.1f;
+		if (beta0 < 1.1f) beta0 = 1.1f;
+		return;
 	}
+
+	double x[4];
+	trust_initial_guess(trust_feedback, x);
+	alpha0 = x[0];
+	beta0 = x[1];
+	ws = x[2];
+	wf = x[3];
+}
+
+float AOptimizer::GetTrustEstimate(float alpha0, float beta0, float ws, float wf)
+{
+	const int ns = history.successes();
+	const int nf = static_cast<int>(history.size()) - ns;
+	const float alpha = alpha0 + ns * ws;
+	const float beta = beta0 + nf * wf;
 	return alpha / (alpha + beta);
 }
 
 void AOptimizer::reset()
 {
-	_trust_feedback.clear();
-	performance_history.clear();
+	StopTimeSlicedUpdate();
+	history.clear();
+	_history_hash = TRUST_HASH_EMPTY;
+	_has_estimate = false;
+}
+
+bool AOptimizer::OpenFitCache(const FString& path)
+{
+	return trust_fit_cache::shared().open(path);
 }
\ No newline at end of file
@@ -0,0 +1,390 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoreMinimal.h"
+#include "HAL/IConsoleManager.h"
+#include "TrustMath.h"
+#include "TrustObjective.h"
+#include "TrustSynthetic.h"
+
+// Serial vs parallel objective evaluation over growing synthetic histories,
+// to pick trust_objective::parallel_min_sites for the target hardware.
+// Usage: trust.BenchReduction [max_sites]
+static void BenchReduction(const TArray<FString>& Args)
+{
+	const int max_sites = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 131072;
+
+	std::vector<int> performance, trust_feedback;
+	FRandomStream rng(1234);
+	for (int i = 0; i < max_sites; i++)
+	{
+		performance.push_back(rng.FRand() < 0.7f ? 1 : 0);
+		trust_feedback.push_back(rng.RandRange(0, 100));
+	}
+
+	trust_objective objective;
+	objective.performance = &performance;
+	objective.trust_feedback = &trust_feedback;
+	const double x[4] = { 20., 30., 0.01, 0.02 };
+	double grad[4];
+
+	UE_LOG(LogTemp, Display, TEXT("sites      serial us  parallel us  speedup"));
+	int crossover = 0;
+	std::vector<int> all_performance = performance, all_feedback = trust_feedback;
+	for (int sites = 256; sites <= max_sites; sites *= 2)
+	{
+		performance.assign(all_performance.begin(), all_performance.begin() + sites);
+		trust_feedback.assign(all_feedback.begin(), all_feedback.begin() + sites);
+
+		// Enough repetitions for roughly a million site evaluations
+		const int reps = FMath::Max(1, (1 << 20) / sites);
+		double seconds[2];
+		for (int mode = 0; mode < 2; mode++)
+		{
+			objective.parallel_min_sites = mode == 0 ? SIZE_MAX : 0;
+			objective(4, x, grad);
+			const double start = FPlatformTime::Seconds();
+			for (int r = 0; r < reps; r++) objective(4, x, grad);
+			seconds[mode] = (FPlatformTime::Seconds() - start) / reps;
+		}
+
+		if (crossover == 0 && seconds[1] < seconds[0] && sites > static_cast<int>(trust_objective::CHUNK_SITES))
+		{
+			crossover = sites;
+		}
+		UE_LOG(LogTemp, Display, TEXT("%-10d %10.1f %12.1f %8.2f"), sites, seconds[0] * 1e6, seconds[1] * 1e6, seconds[0] / seconds[1]);
+	}
+
+	if (crossover > 0)
+	{
+		UE_LOG(LogTemp, Display, TEXT("Parallel reduction wins from about %d sites"), crossover);
+	}
+	else
+	{
+		UE_LOG(LogTemp, Display, TEXT("Parallel reduction did not win up to %d sites"), max_sites);
+	}
+}
+
+static FAutoConsoleCommand BenchReductionCommand(
+	TEXT("trust.BenchReduction"),
+	TEXT("Times serial vs parallel trust likelihood evaluation and prints the crossover history length"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&BenchReduction));
+
+// Compare trust_math::log_beta_terms with long double boost::math over
+// a, b log-uniform in [STIRLING_MIN, 1e6], corners included, and log an
+// error if it is off by more than LOG_BETA_TOL (relative, log-Beta) or
+// DIGAMMA_TOL (absolute, digamma differences).
+// Usage: trust.CheckLogBeta [samples]
+static void CheckLogBeta(const TArray<FString>& Args)
+{
+	const int samples = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 100000;
+	const double lo = trust_math::STIRLING_MIN;
+	const double hi = 1e6;
+
+	FRandomStream rng(1234);
+	double max_rel = 0., max_digamma = 0.;
+	double worst[2] = { lo, lo };
+	for (int i = 0; i < samples + 4; i++)
+	{
+		double a, b;
+		if (i < 4)
+		{
+			a = (i & 1) ? hi : lo;
+			b = (i & 2) ? hi : lo;
+		}
+		else
+		{
+			a = lo * std::pow(hi / lo, (double)rng.FRand());
+			b = lo * std::pow(hi / lo, (double)rng.FRand());
+		}
+
+		double da, db;
+		const double value = trust_math::log_beta_terms(a, b, &da, &db);
+
+		const long double la = a, lb = b, lc = la + lb;
+		const long double ref = boost::math::lgamma(lc) - boost::math::lgamma(la) - boost::math::lgamma(lb);
+		const long double psi_c = boost::math::digamma(lc);
+		const long double ref_da = psi_c - boost::math::digamma(la);
+		const long double ref_db = psi_c - boost::math::digamma(lb);
+
+		const double rel = static_cast<double>(FMath::Abs(value - ref) / FMath::Abs(ref));
+		if (rel > max_rel)
+		{
+			max_rel = rel;
+			worst[0] = a;
+			worst[1] = b;
+		}
+		max_digamma = FMath::Max(max_digamma, static_cast<double>(FMath::Max(FMath::Abs(da - ref_da), FMath::Abs(db - ref_db))));
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("log-Beta max relative error %.3g at (%g, %g), digamma differences max error %.3g"),
+		   max_rel, worst[0], worst[1], max_digamma);
+	if (max_rel > trust_math::LOG_BETA_TOL || max_digamma > trust_math::DIGAMMA_TOL)
+	{
+		UE_LOG(LogTemp, Error, TEXT("trust.CheckLogBeta: log_beta_terms exceeds its tolerance (%g relative, %g absolute)"),
+			   trust_math::LOG_BETA_TOL, trust_math::DIGAMMA_TOL);
+	}
+	else
+	{
+		UE_LOG(LogTemp, Display, TEXT("trust.CheckLogBeta: %d samples within tolerance"), samples + 4);
+	}
+}
+
+static FAutoConsoleCommand CheckLogBetaCommand(
+	TEXT("trust.CheckLogBeta"),
+	TEXT("Checks the Stirling log-Beta and digamma terms against boost::math over [10, 1e6]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&CheckLogBeta));
+
+// Fit a synthetic study drawn from known parameters and print how well the
+// fits recover them, with the online profile and a converged one.
+// Usage: trust.Recovery [participants] [sites] [spread] [alpha0 beta0 ws wf]
+static void Recovery(const TArray<FString>& Args)
+{
+	trust_synthetic_config config;
+	if (Args.Num() > 0) config.num_participants = FCString::Atoi(*Args[0]);
+	if (Args.Num() > 1) config.min_sites = config.max_sites = FCString::Atoi(*Args[1]);
+	if (Args.Num() > 2) config.spread = FCString::Atod(*Args[2]);
+	for (int k = 0; k < 4 && Args.Num() > 3 + k; k++) config.x[k] = FCString::Atod(*Args[3 + k]);
+
+	UE_LOG(LogTemp, Display, TEXT("%d participants, %d sites, truth (%g, %g, %g, %g), spread %g"), config.num_participants,
+		   config.min_sites, config.x[0], config.x[1], config.x[2], config.x[3], config.spread);
+	UE_LOG(LogTemp, Display, TEXT("profile    bias alpha0/beta0/ws/wf          rmse alpha0/beta0/ws/wf          trust mae  evals  seconds"));
+	const TCHAR* names[2] = { TEXT("online"), TEXT("converged") };
+	const trust_profile profiles[2] = { trust_profile(), trust_profile::converged() };
+	for (int m = 0; m < 2; m++)
+	{
+		const trust_recovery r = trust_check_recovery(config, profiles[m]);
+		UE_LOG(LogTemp, Display, TEXT("%-10s %7.2f %7.2f %7.2f %7.2f  %7.2f %7.2f %7.2f %7.2f  %9.4f %6.1f %8.2f"), names[m],
+			   r.bias[0], r.bias[1], r.bias[2], r.bias[3], r.rmse[0], r.rmse[1], r.rmse[2], r.rmse[3],
+			   r.trajectory_mae, r.mean_evals, r.seconds);
+	}
+}
+
+static FAutoConsoleCommand RecoveryCommand(
+	TEXT("trust.Recovery"),
+	TEXT("Fits a synthetic study with known trust parameters and prints the estimation error"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&Recovery));
+
+// Bounded against reparameterized solves of the same synthetic study, one
+// converged fit per participant from the first-feedback initial guess.
+// Prints evaluations to convergence, time, how many solutions end near a
+// bound, and the mean log-likelihood gained over the bounded solve.
+// Usage: trust.BenchReparam [participants] [sites] [alpha0 beta0 ws wf]
+static void BenchReparam(const TArray<FString>& Args)
+{
+	trust_synthetic_config config;
+	config.num_participants = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 500;
+	config.min_sites = config.max_sites = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 40;
+	// Default truth with a success weight near its lower bound
+	config.x[2] = 0.3;
+	config.spread = 0.5;
+	for (int k = 0; k < 4 && Args.Num() > 2 + k; k++) config.x[k] = FCString::Atod(*Args[2 + k]);
+
+	std::vector<trust_history> histories;
+	trust_synthesize_study(config, histories);
+	const int J = static_cast<int>(histories.size());
+	if (J == 0) return;
+
+	UE_LOG(LogTemp, Display, TEXT("%d participants, %d sites, truth (%g, %g, %g, %g), spread %g"), J, config.max_sites,
+		   config.x[0], config.x[1], config.x[2], config.x[3], config.spread);
+	UE_LOG(LogTemp, Display, TEXT("mode             mean evals  max evals   seconds  near bound  logl gain"));
+
+	std::vector<double> bounded_logl(J, 0.);
+	for (int mode = 0; mode < 2; mode++)
+	{
+		trust_profile profile = trust_profile::converged();
+		profile.reparameterize = mode == 1;
+
+		std::vector<int> evals(J, 0);
+		std::vector<double> logl(J, 0.);
+		std::vector<int> near_bound(J, 0);
+		const double start = FPlatformTime::Seconds();
+		ParallelFor(J, [&](int32 j)
+		{
+			const trust_history& h = histories[j];
+			double x[4];
+			trust_initial_guess(h.trust_feedback[0], x);
+			trust_fit(h.performance, h.trust_feedback, profile, x, &evals[j]);
+
+			trust_objective objective;
+			objective.performance = &h.performance;
+			objective.trust_feedback = &h.trust_feedback;
+			logl[j] = objective(4, x, nullptr);
+			for (int k = 0; k < 4; k++)
+			{
+				const double margin = 0.01 * (trust_ub[k] - trust_lb[k]);
+				if (x[k] < trust_lb[k] + margin || x[k] > trust_ub[k] - margin) near_bound[j] = 1;
+			}
+		});
+		const double seconds = FPlatformTime::Seconds() - start;
+
+		double mean_evals = 0., gain = 0.;
+		int max_evals = 0, num_near = 0;
+		for (int j = 0; j < J; j++)
+		{
+			mean_evals += evals[j];
+			max_evals = FMath::Max(max_evals, evals[j]);
+			num_near += near_bound[j];
+			if (mode == 0) bounded_logl[j] = logl[j];
+			gain += logl[j] - bounded_logl[j];
+		}
+		UE_LOG(LogTemp, Display, TEXT("%-16s %10.1f %10d %9.3f %11d %10.4f"), mode == 0 ? TEXT("bounded") : TEXT("reparameterized"),
+			   mean_evals / J, max_evals, seconds, num_near, gain / J);
+	}
+}
+
+static FAutoConsoleCommand BenchReparamCommand(
+	TEXT("trust.BenchReparam"),
+	TEXT("Compares evaluations to convergence of bounded and reparameterized trust fits on a synthetic study"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&BenchReparam));
+
+// Single fits from the first-feedback initial guess against multistart fits
+// (trust_multistart_fit) of the same synthetic study, participant after
+// participant, so the multistart has all cores for its starts. Prints time,
+// evaluations, and how much log-likelihood the multistart gains.
+// Usage: trust.BenchMultistart [participants] [starts] [sites]
+static void BenchMultistart(const TArray<FString>& Args)
+{
+	trust_synthetic_config config;
+	config.num_participants = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 100;
+	const int num_starts = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 16;
+	config.min_sites = config.max_sites = Args.Num() > 2 ? FCString::Atoi(*Args[2]) : 40;
+	config.spread = 0.5;
+
+	std::vector<trust_history> histories;
+	trust_synthesize_study(config, histories);
+	const int J = static_cast<int>(histories.size());
+	if (J == 0) return;
+
+	const trust_profile profile = trust_profile::converged();
+	std::vector<double> single_logl(J, 0.);
+	double single_seconds = 0., multi_seconds = 0.;
+	int64 single_evals = 0, multi_evals = 0;
+	double gain = 0.;
+	int improved = 0;
+	for (int j = 0; j < J; j++)
+	{
+		const trust_history& h = histories[j];
+		double x[4];
+		int evals = 0;
+
+		double start = FPlatformTime::Seconds();
+		trust_initial_guess(h.trust_feedback[0], x);
+		trust_fit(h.performance, h.trust_feedback, profile, x, &evals);
+		single_seconds += FPlatformTime::Seconds() - start;
+		single_evals += evals;
+		trust_objective objective;
+		objective.performance = &h.performance;
+		objective.trust_feedback = &h.trust_feedback;
+		const double logl = objective(4, x, nullptr);
+
+		start = FPlatformTime::Seconds();
+		trust_initial_guess(h.trust_feedback[0], x);
+		const double best = trust_multistart_fit(h.performance, h.trust_feedback, profile, num_starts, config.seed, x, &evals);
+		multi_seconds += FPlatformTime::Seconds() - start;
+		multi_evals += evals;
+
+		gain += best - logl;
+		if (best > logl + 1e-6) improved++;
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("%d participants, %d sites, %d starts, converged profile"), J, config.max_sites, num_starts);
+	UE_LOG(LogTemp, Display, TEXT("mode         seconds  evals/fit"));
+	UE_LOG(LogTemp, Display, TEXT("single     %9.3f %10.1f"), single_seconds, (double)single_evals / J);
+	UE_LOG(LogTemp, Display, TEXT("multistart %9.3f %10.1f"), multi_seconds, (double)multi_evals / J);
+	UE_LOG(LogTemp, Display, TEXT("Multistart improves %d of %d fits, mean log-likelihood gain %.4f"), improved, J, gain / J);
+}
+
+static FAutoConsoleCommand BenchMultistartCommand(
+	TEXT("trust.BenchMultistart"),
+	TEXT("Compares single trust fits with parallel multistart fits over the trust bounds on a synthetic study"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&BenchMultistart));
+
+// Seeded stochastic fit of one history, global search over the trust bounds
+static void stochastic_fit(const trust_history& h, unsigned long seed, double x[4])
+{
+	nlopt::opt opt(nlopt::GN_CRS2_LM, 4);
+	opt.set_lower_bounds(std::vector<double>(trust_lb, trust_lb + 4));
+	opt.set_upper_bounds(std::vector<double>(trust_ub, trust_ub + 4));
+	opt.set_maxeval(200);
+	opt.set_rand_seed(seed);
+
+	trust_objective objective;
+	objective.performance = &h.performance;
+	objective.trust_feedback = &h.trust_feedback;
+	opt.set_max_objective_typed<4>(objective);
+
+	std::vector<double> x0 = { 50., 50., 1., 2. };
+	double logl;
+	try {
+		opt.optimize(x0, logl);
+	}
+	catch (...) {
+	}
+	for (int k = 0; k < 4; k++) x[k] = x0[k];
+}
+
+// Manual console check, not a thread-safety test: runs every fit of a
+// synthetic study once serially, then twice over concurrently, and compares
+// each concurrent result bit for bit with the serial one, for the online
+// fits and for seeded stochastic fits (see nlopt::opt::set_rand_seed).
+// Matching results on one run do not prove the fits free of data races.
+// Logs an error for every mismatch.
+// Usage: trust.ConcurrentFits [fits]
+static void ConcurrentFits(const TArray<FString>& Args)
+{
+	trust_synthetic_config config;
+	config.num_participants = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 256;
+	config.spread = 0.5;
+
+	std::vector<trust_history> histories;
+	trust_synthesize_study(config, histories);
+	const int J = static_cast<int>(histories.size());
+	if (J == 0) return;
+
+	const TCHAR* names[2] = { TEXT("online"), TEXT("stochastic") };
+	auto fit = [&histories](int mode, int j, double x[4])
+	{
+		if (mode == 0)
+		{
+			trust_initial_guess(histories[j].trust_feedback[0], x);
+			trust_fit(histories[j].performance, histories[j].trust_feedback, trust_profile(), x);
+		}
+		else
+		{
+			stochastic_fit(histories[j], 1000 + j, x);
+		}
+	};
+
+	for (int mode = 0; mode < 2; mode++)
+	{
+		std::vector<double> serial(4 * J), concurrent(8 * J);
+		for (int j = 0; j < J; j++) fit(mode, j, &serial[4 * j]);
+
+		// Fits k and k + J solve the same history at the same time
+		ParallelFor(2 * J, [&](int32 k)
+		{
+			fit(mode, k % J, &concurrent[4 * k]);
+		});
+
+		int mismatches = 0;
+		for (int k = 0; k < 2 * J; k++)
+		{
+			if (FMemory::Memcmp(&concurrent[4 * k], &serial[4 * (k % J)], 4 * sizeof(double)) != 0) mismatches++;
+		}
+		if (mismatches > 0)
+		{
+			UE_LOG(LogTemp, Error, TEXT("trust.ConcurrentFits: %d of %d concurrent %s fits differ from the serial ones"),
+				   mismatches, 2 * J, names[mode]);
+		}
+		else
+		{
+			UE_LOG(LogTemp, Display, TEXT("trust.ConcurrentFits: %d concurrent %s fits match the serial ones"), 2 * J, names[mode]);
+		}
+	}
+}
+
+static FAutoConsoleCommand ConcurrentFitsCommand(
+	TEXT("trust.ConcurrentFits"),
+	TEXT("Checks that concurrent online and seeded stochastic trust fits reproduce their serial results"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&ConcurrentFits));
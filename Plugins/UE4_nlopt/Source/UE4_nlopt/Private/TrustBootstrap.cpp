@@ -0,0 +1,85 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TrustBootstrap.h"
+#include "TrustSynthetic.h"
+#include "Async/ParallelFor.h"
+#include <algorithm>
+
+// Linearly interpolated percentile of values (sorted in place)
+static trust_interval percentile_interval(std::vector<double>& values, double level)
+{
+	std::sort(values.begin(), values.end());
+	const double tail = 0.5 * (1. - level);
+	auto quantile = [&values](double q)
+	{
+		const double pos = q * (values.size() - 1);
+		const size_t i = static_cast<size_t>(pos);
+		if (i + 1 >= values.size()) return values.back();
+		return values[i] + (pos - i) * (values[i + 1] - values[i]);
+	};
+	return trust_interval{ quantile(tail), quantile(1. - tail) };
+}
+
+trust_bootstrap::trust_bootstrap()
+	: replicates(200), level(0.95), seed(1), profile(trust_profile::converged())
+{
+	for (int k = 0; k < 4; k++)
+	{
+		_estimate[k] = 0.;
+		_parameter_intervals[k] = trust_interval{ 0., 0. };
+	}
+}
+
+bool trust_bootstrap::run(const std::vector<int>& performance, const std::vector<int>& trust_feedback, const double x_start[4])
+{
+	const size_t N = performance.size();
+	if (N < 2 || replicates < 1) return false;
+
+	// Full-data solution, the warm start of every replicate
+	for (int k = 0; k < 4; k++) _estimate[k] = x_start[k];
+	trust_fit(performance, trust_feedback, profile, _estimate);
+	_trajectory.resize(N);
+	trust_trajectory(performance, _estimate, _trajectory.data());
+
+	const int B = replicates;
+	_replicates.assign(4 * B, 0.);
+	std::vector<double> trajectories(B * N);
+	ParallelFor(B, [&](int32 b)
+	{
+		FRandomStream rng(static_cast<int32>(HashCombine(seed, static_cast<uint32>(b))));
+
+		// Redraw the feedback from the fitted model, as trust_synthesize does
+		std::vector<int> f(N);
+		double alpha = _estimate[0];
+		double beta = _estimate[1];
+		for (size_t i = 0; i < N; i++)
+		{
+			const int p = performance[i];
+			alpha += p * _estimate[2];
+			beta += (1 - p) * _estimate[3];
+			const double t = trust_sample_beta(rng, alpha, beta);
+			f[i] = FMath::Clamp(static_cast<int>(t * 100. + 0.5), 0, 100);
+		}
+
+		double* x = &_replicates[4 * b];
+		for (int k = 0; k < 4; k++) x[k] = _estimate[k];
+		trust_fit(performance, f, profile, x);
+		trust_trajectory(performance, x, &trajectories[b * N]);
+	});
+
+	std::vector<double> column(B);
+	for (int k = 0; k < 4; k++)
+	{
+		for (int b = 0; b < B; b++) column[b] = _replicates[4 * b + k];
+		_parameter_intervals[k] = percentile_interval(column, level);
+	}
+
+	_trajectory_intervals.resize(N);
+	for (size_t i = 0; i < N; i++)
+	{
+		for (int b = 0; b < B; b++) column[b] = trajectories[b * N + i];
+		_trajectory_intervals[i] = percentile_interval(column, level);
+	}
+	return true;
+}
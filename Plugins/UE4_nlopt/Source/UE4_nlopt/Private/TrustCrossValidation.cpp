@@ -0,0 +1,182 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TrustCrossValidation.h"
+#include "Async/ParallelFor.h"
+#include <cmath>
+
+void trust_site_terms::build(const trust_history& history)
+{
+	const size_t N = history.performance.size();
+	logt.resize(N);
+	log1t.resize(N);
+	t.resize(N);
+	ns.resize(N);
+	nf.resize(N);
+
+	int s = 0, f = 0;
+	for (size_t i = 0; i < N; i++)
+	{
+		const int p = history.performance[i];
+		s += p;
+		f += (1 - p);
+		ns[i] = s;
+		nf[i] = f;
+
+		double ti = (double)history.trust_feedback[i] / 100.;
+		t[i] = ti;
+		if (ti < 0.01) ti = 0.01;
+		if (ti > 0.99) ti = 0.99;
+		logt[i] = (double) FMath::Loge(ti);
+		log1t[i] = (double) FMath::Loge(1. - ti);
+	}
+}
+
+double trust_fold_objective::operator()(unsigned n, const double* x, double* grad) const
+{
+	if (_opt && _max_evals > 0 && _opt->get_numevals() >= _max_evals)
+	{
+		_opt->force_stop();
+	}
+
+	const trust_site_terms& c = *terms;
+	const std::vector<int>& fold = *fold_of_site;
+	trust_partial r;
+	for (size_t i = 0; i < c.size(); i++)
+	{
+		if (fold[i] == held_out) continue;
+
+		const double alpha = x[0] + c.ns[i] * x[2];
+		const double beta = x[1] + c.nf[i] * x[3];
+		double dpsi_alpha, dpsi_beta;
+		r.logl += trust_math::log_beta_terms(alpha, beta, grad ? &dpsi_alpha : nullptr, grad ? &dpsi_beta : nullptr);
+		r.logl += (alpha - 1) * c.logt[i] + (beta - 1) * c.log1t[i];
+
+		if (!grad) continue;
+
+		r.grad[0] += (dpsi_alpha + c.logt[i]);
+		r.grad[1] += (dpsi_beta + c.log1t[i]);
+		r.grad[2] += (dpsi_alpha + c.logt[i]) * c.ns[i];
+		r.grad[3] += (dpsi_beta + c.log1t[i]) * c.nf[i];
+	}
+
+	if (grad)
+	{
+		for (unsigned i = 0; i < n; i++) grad[i] = i < 4 ? r.grad[i] : 0.;
+	}
+	return r.logl;
+}
+
+trust_cross_validation::trust_cross_validation()
+	: num_folds(10), has_x_start(false)
+{
+	for (int k = 0; k < 4; k++) x_start[k] = 0.;
+}
+
+bool trust_cross_validation::run(const std::vector<trust_history>& histories)
+{
+	const size_t J = histories.size();
+	_participants.assign(J, trust_cv_score());
+	_aggregate = trust_cv_score();
+
+	// Cached terms, fold assignment and full-data fit of each participant
+	std::vector<trust_site_terms> terms(J);
+	std::vector<std::vector<int>> fold_of_site(J);
+	std::vector<int> folds(J);
+	std::vector<double> x_full(4 * J);
+	ParallelFor(static_cast<int32>(J), [&](int32 j)
+	{
+		const trust_history& h = histories[j];
+		const int N = static_cast<int>(h.performance.size());
+		terms[j].build(h);
+
+		folds[j] = (num_folds <= 0 || num_folds > N) ? N : num_folds;
+		fold_of_site[j].resize(N);
+		for (int i = 0; i < N; i++) fold_of_site[j][i] = i % folds[j];
+
+		double* x = &x_full[4 * j];
+		if (has_x_start)
+		{
+			for (int k = 0; k < 4; k++) x[k] = x_start[k];
+		}
+		else
+		{
+			trust_initial_guess(N > 0 ? h.trust_feedback[0] : 50, x);
+		}
+		if (N < 2) return;
+
+		trust_fold_objective objective;
+		objective.terms = &terms[j];
+		objective.fold_of_site = &fold_of_site[j];
+		objective.held_out = -1;
+		trust_fit_objective(objective, profile, x);
+	});
+
+	// Flatten (participant, fold) pairs so short and long histories share the threads
+	std::vector<int> task_participant, task_fold;
+	for (size_t j = 0; j < J; j++)
+	{
+		if (terms[j].size() < 2) continue;
+		for (int f = 0; f < folds[j]; f++)
+		{
+			task_participant.push_back(static_cast<int>(j));
+			task_fold.push_back(f);
+		}
+	}
+	if (task_participant.empty()) return false;
+
+	std::vector<trust_cv_score> task_scores(task_participant.size());
+	std::vector<double> task_sse(task_participant.size());
+	ParallelFor(static_cast<int32>(task_participant.size()), [&](int32 task)
+	{
+		const int j = task_participant[task];
+		const trust_site_terms& c = terms[j];
+		trust_fold_objective objective;
+		objective.terms = &c;
+		objective.fold_of_site = &fold_of_site[j];
+		objective.held_out = task_fold[task];
+
+		double x[4];
+		for (int k = 0; k < 4; k++) x[k] = x_full[4 * j + k];
+		trust_cv_score& score = task_scores[task];
+		trust_fit_objective(objective, profile, x, &score.numevals);
+
+		// Score the held-out sites
+		double sse = 0.;
+		for (size_t i = objective.held_out; i < c.size(); i += folds[j])
+		{
+			const double alpha = x[0] + c.ns[i] * x[2];
+			const double beta = x[1] + c.nf[i] * x[3];
+			score.logl += trust_math::log_beta_terms(alpha, beta);
+			score.logl += (alpha - 1) * c.logt[i] + (beta - 1) * c.log1t[i];
+			const double e = alpha / (alpha + beta) - c.t[i];
+			sse += e * e;
+			score.num_heldout++;
+		}
+		task_sse[task] = sse;
+	});
+
+	// Sum in task order, so the scores do not depend on the thread count
+	std::vector<double> sse(J, 0.);
+	for (size_t task = 0; task < task_scores.size(); task++)
+	{
+		const int j = task_participant[task];
+		_participants[j].logl += task_scores[task].logl;
+		_participants[j].num_heldout += task_scores[task].num_heldout;
+		_participants[j].numevals += task_scores[task].numevals;
+		sse[j] += task_sse[task];
+	}
+
+	double total_sse = 0.;
+	for (size_t j = 0; j < J; j++)
+	{
+		trust_cv_score& score = _participants[j];
+		if (score.num_heldout > 0) score.rmse = std::sqrt(sse[j] / score.num_heldout);
+		_aggregate.logl += score.logl;
+		_aggregate.num_heldout += score.num_heldout;
+		_aggregate.numevals += score.numevals;
+		total_sse += sse[j];
+	}
+	_aggregate.rmse = std::sqrt(total_sse / _aggregate.num_heldout);
+	return true;
+}
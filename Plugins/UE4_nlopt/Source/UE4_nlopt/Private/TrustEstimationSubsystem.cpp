@@ -0,0 +1,87 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TrustEstimationSubsystem.h"
+#include "Optimizer.h"
+#include "Async/ParallelFor.h"
+
+void UTrustEstimationSubsystem::Submit(AOptimizer* optimizer, int performance, int trust_feedback, float alpha0_last, float beta0_last, float ws_last, float wf_last)
+{
+	if (!optimizer) return;
+
+	optimizer->AddSample(performance, trust_feedback);
+
+	// Not enough data to fit yet
+	if (optimizer->history.size() < 2)
+	{
+		optimizer->GetInitialGuess(trust_feedback, optimizer->alpha0_best, optimizer->beta0_best, optimizer->ws_best, optimizer->wf_best);
+		return;
+	}
+
+	// Coalesce with an update already queued this frame, the latest estimate wins
+	pending_update* update = _pending.FindByPredicate([optimizer](const pending_update& u) { return u.optimizer.Get() == optimizer; });
+	if (!update)
+	{
+		update = &_pending.AddDefaulted_GetRef();
+		update->optimizer = optimizer;
+	}
+	update->x0[0] = alpha0_last;
+	update->x0[1] = beta0_last;
+	update->x0[2] = ws_last;
+	update->x0[3] = wf_last;
+}
+
+void UTrustEstimationSubsystem::Flush()
+{
+	// Drop actors destroyed since they submitted
+	_pending.RemoveAll([](const pending_update& u) { return !u.optimizer.IsValid(); });
+	if (_pending.Num() == 0) return;
+
+	// Weak pointers may only be resolved on the game thread, which blocks in
+	// ParallelFor below, so the actors stay alive while the workers use them
+	TArray<AOptimizer*> optimizers;
+	optimizers.Reserve(_pending.Num());
+	for (const pending_update& u : _pending) optimizers.Add(u.optimizer.Get());
+
+	// Each actor owns its optimizer and history, so the solves are independent
+	ParallelFor(_pending.Num(), [this, &optimizers](int32 i)
+	{
+		pending_update& u = _pending[i];
+		AOptimizer* optimizer = optimizers[i];
+		// Fold in events posted from other threads since the last frame
+		optimizer->DrainEvents();
+		optimizer->Solve(u.x0[0], u.x0[1], u.x0[2], u.x0[3], u.x[0], u.x[1], u.x[2], u.x[3]);
+	});
+
+	// Publish on the game thread
+	for (int32 i = 0; i < _pending.Num(); i++)
+	{
+		const pending_update& u = _pending[i];
+		AOptimizer* optimizer = optimizers[i];
+		optimizer->alpha0_best = u.x[0];
+		optimizer->beta0_best = u.x[1];
+		optimizer->ws_best = u.x[2];
+		optimizer->wf_best = u.x[3];
+	}
+	_pending.Reset();
+}
+
+void UTrustEstimationSubsystem::Tick(float DeltaTime)
+{
+	Flush();
+}
+
+bool UTrustEstimationSubsystem::IsTickable() const
+{
+	return !HasAnyFlags(RF_ClassDefaultObject) && _pending.Num() > 0;
+}
+
+TStatId UTrustEstimationSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UTrustEstimationSubsystem, STATGROUP_Tickables);
+}
+
+UWorld* UTrustEstimationSubsystem::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
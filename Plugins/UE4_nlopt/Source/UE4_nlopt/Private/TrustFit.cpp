@@ -0,0 +1,63 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TrustFit.h"
+#include <cmath>
+
+nlopt::result trust_fit(const std::vector<int>& performance, const std::vector<int>& trust_feedback,
+						const trust_profile& profile, double x[4], int* numevals)
+{
+	trust_objective objective;
+	objective.performance = &performance;
+	objective.trust_feedback = &trust_feedback;
+	return trust_fit_objective(objective, profile, x, numevals);
+}
+
+double trust_multistart_fit(const std::vector<int>& performance, const std::vector<int>& trust_feedback,
+							const trust_profile& profile, int num_starts, uint32 seed, double x[4], int* numevals)
+{
+	const int K = FMath::Max(num_starts, 1);
+	std::vector<double> fits(4 * K);
+	std::vector<double> logl(K);
+	std::vector<int> evals(K, 0);
+	ParallelFor(K, [&](int32 k)
+	{
+		double* xk = &fits[4 * k];
+		FRandomStream rng(static_cast<int32>(HashCombine(seed, static_cast<uint32>(k))));
+		for (int i = 0; i < 4; i++)
+		{
+			xk[i] = k == 0 ? x[i] : trust_lb[i] * std::pow(trust_ub[i] / trust_lb[i], static_cast<double>(rng.FRand()));
+		}
+		trust_fit(performance, trust_feedback, profile, xk, &evals[k]);
+
+		trust_objective objective;
+		objective.performance = &performance;
+		objective.trust_feedback = &trust_feedback;
+		logl[k] = objective(4, xk, nullptr);
+	});
+
+	int best = 0;
+	for (int k = 1; k < K; k++)
+	{
+		if (logl[k] > logl[best]) best = k;
+	}
+	for (int i = 0; i < 4; i++) x[i] = fits[4 * best + i];
+	if (numevals)
+	{
+		*numevals = 0;
+		for (int k = 0; k < K; k++) *numevals += evals[k];
+	}
+	return logl[best];
+}
+
+void trust_trajectory(const std::vector<int>& performance, const double x[4], double* trust)
+{
+	double alpha = x[0], beta = x[1];
+	for (size_t i = 0; i < performance.size(); i++)
+	{
+		const int p = performance[i];
+		alpha += p * x[2];
+		beta += (1 - p) * x[3];
+		trust[i] = alpha / (alpha + beta);
+	}
+}
@@ -0,0 +1,283 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TrustFitCache.h"
+#include "HAL/PlatformFilemanager.h"
+#include "GenericPlatform/GenericPlatformFile.h"
+#include "Misc/ScopeLock.h"
+#include <cstring>
+
+namespace
+{
+	const uint64 FNV_PRIME = 0x100000001b3ull;
+	const char CACHE_MAGIC[8] = { 'T', 'R', 'U', 'S', 'T', 'F', 'I', 'T' };
+
+	// Record layout and key hashing, bump when either changes
+	const uint32 CACHE_FORMAT = 3;
+
+	// Magic, format and model version, padded to a record word
+	struct cache_header
+	{
+		char magic[8];
+		uint32 format;
+		uint32 model;
+	};
+	static_assert(sizeof(cache_header) == 16, "fit cache header layout");
+	const int64 HEADER_BYTES = sizeof(cache_header);
+
+	cache_header current_header()
+	{
+		cache_header header;
+		std::memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+		header.format = CACHE_FORMAT;
+		header.model = TRUST_MODEL_VERSION;
+		return header;
+	}
+
+	// Key, parameters, log-likelihood, evaluation count and checksum
+	const int RECORD_WORDS = 8;
+	const int64 RECORD_BYTES = RECORD_WORDS * sizeof(uint64);
+	const int64 SCAN_RECORDS = 4096;
+
+	uint64 fnv_bytes(uint64 hash, const void* data, size_t size)
+	{
+		const uint8* bytes = static_cast<const uint8*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= FNV_PRIME;
+		}
+		return hash;
+	}
+
+	// splitmix64 finalizer, spreads the FNV state over all bits
+	uint64 mix(uint64 z)
+	{
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+
+	// Of every word of a record but the checksum itself
+	uint64 checksum(const uint64* record)
+	{
+		return mix(fnv_bytes(record[0], record + 1, (RECORD_WORDS - 2) * sizeof(uint64)));
+	}
+}
+
+uint64 trust_hash_site(uint64 hash, int performance, int trust_feedback)
+{
+	const int32 site[2] = { performance, trust_feedback };
+	return fnv_bytes(hash, site, sizeof(site));
+}
+
+uint64 trust_fit_key(uint64 history_hash, const double x0[4], const trust_profile& profile)
+{
+	uint64 hash = fnv_bytes(history_hash, x0, 4 * sizeof(double));
+	const int32 ints[3] = { static_cast<int32>(profile.algorithm), profile.maxeval, profile.max_evals };
+	const double tols[3] = { profile.xtol_rel, profile.ftol_rel, profile.ftol_abs };
+	hash = fnv_bytes(hash, ints, sizeof(ints));
+	hash = fnv_bytes(hash, tols, sizeof(tols));
+	const uint8 reparameterize = profile.reparameterize ? 1 : 0;
+	hash = fnv_bytes(hash, &reparameterize, 1);
+	return mix(hash);
+}
+
+trust_fit_cache::trust_fit_cache(size_t capacity)
+	: _capacity(capacity), _disk_size(0), _unflushed(false),
+	  _memory_hits(0), _disk_hits(0), _misses(0)
+{
+}
+
+trust_fit_cache::~trust_fit_cache()
+{
+	close();
+}
+
+trust_fit_cache& trust_fit_cache::shared()
+{
+	static trust_fit_cache cache;
+	return cache;
+}
+
+bool trust_fit_cache::open(const FString& path)
+{
+	close();
+	FScopeLock lock(&_lock);
+
+	IPlatformFile& platform_file = FPlatformFileManager::Get().GetPlatformFile();
+	_writer.reset(platform_file.OpenWrite(*path, true, true));
+	if (_writer) _reader.reset(platform_file.OpenRead(*path, true));
+	if (!_writer || !_reader)
+	{
+		_writer.reset();
+		_reader.reset();
+		return false;
+	}
+
+	const cache_header expected = current_header();
+	const int64 size = _reader->Size();
+	if (size < HEADER_BYTES)
+	{
+		// New (or truncated before the header was complete) file
+		if (size > 0)
+		{
+			_writer.reset();
+			_reader.reset();
+			return false;
+		}
+		_writer->Write(reinterpret_cast<const uint8*>(&expected), HEADER_BYTES);
+		_disk_size = HEADER_BYTES;
+		_unflushed = true;
+		return true;
+	}
+
+	// Another format or model version maps the same keys to other fits
+	cache_header header;
+	_reader->Seek(0);
+	if (!_reader->Read(reinterpret_cast<uint8*>(&header), HEADER_BYTES) ||
+		std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+		header.format != expected.format || header.model != expected.model)
+	{
+		_writer.reset();
+		_reader.reset();
+		return false;
+	}
+
+	// Index the complete records, skipping any that fail their checksum
+	const int64 num_records = (size - HEADER_BYTES) / RECORD_BYTES;
+	std::vector<uint64> chunk(RECORD_WORDS * SCAN_RECORDS);
+	for (int64 first = 0; first < num_records; first += SCAN_RECORDS)
+	{
+		const int64 count = FMath::Min(SCAN_RECORDS, num_records - first);
+		if (!_reader->Read(reinterpret_cast<uint8*>(chunk.data()), count * RECORD_BYTES)) break;
+		for (int64 r = 0; r < count; r++)
+		{
+			const uint64* record = &chunk[RECORD_WORDS * r];
+			if (checksum(record) != record[RECORD_WORDS - 1]) continue;
+			_disk_index[record[0]] = HEADER_BYTES + (first + r) * RECORD_BYTES;
+		}
+	}
+
+	// Pad a torn last record, so appended records stay aligned
+	_disk_size = HEADER_BYTES + num_records * RECORD_BYTES;
+	if (_disk_size < size)
+	{
+		const std::vector<uint8> padding(static_cast<size_t>(_disk_size + RECORD_BYTES - size), 0);
+		_writer->Write(padding.data(), padding.size());
+		_disk_size += RECORD_BYTES;
+		_unflushed = true;
+	}
+	return true;
+}
+
+void trust_fit_cache::close()
+{
+	FScopeLock lock(&_lock);
+	if (_writer) _writer->Flush();
+	_writer.reset();
+	_reader.reset();
+	_disk_index.clear();
+	_disk_size = 0;
+	_unflushed = false;
+}
+
+bool trust_fit_cache::find(uint64 key, double x[4], double& logl, int& numevals)
+{
+	FScopeLock lock(&_lock);
+
+	auto it = _memory.find(key);
+	if (it != _memory.end())
+	{
+		_lru.splice(_lru.begin(), _lru, it->second);
+		for (int k = 0; k < 4; k++) x[k] = it->second->x[k];
+		logl = it->second->logl;
+		numevals = it->second->numevals;
+		_memory_hits++;
+		return true;
+	}
+
+	auto on_disk = _disk_index.find(key);
+	entry e;
+	if (on_disk != _disk_index.end() && read_record(on_disk->second, e) && e.key == key)
+	{
+		remember(e);
+		for (int k = 0; k < 4; k++) x[k] = e.x[k];
+		logl = e.logl;
+		numevals = e.numevals;
+		_disk_hits++;
+		return true;
+	}
+
+	_misses++;
+	return false;
+}
+
+void trust_fit_cache::insert(uint64 key, const double x[4], double logl, int numevals)
+{
+	FScopeLock lock(&_lock);
+	entry e;
+	e.key = key;
+	for (int k = 0; k < 4; k++) e.x[k] = x[k];
+	e.logl = logl;
+	e.numevals = numevals;
+	remember(e);
+
+	if (!_writer || _disk_index.count(key)) return;
+
+	uint64 record[RECORD_WORDS];
+	record[0] = key;
+	std::memcpy(record + 1, x, 4 * sizeof(double));
+	std::memcpy(record + 5, &logl, sizeof(double));
+	record[6] = static_cast<uint64>(numevals);
+	record[7] = checksum(record);
+	if (!_writer->Write(reinterpret_cast<const uint8*>(record), RECORD_BYTES)) return;
+	_disk_index[key] = _disk_size;
+	_disk_size += RECORD_BYTES;
+	_unflushed = true;
+}
+
+void trust_fit_cache::clear()
+{
+	FScopeLock lock(&_lock);
+	_lru.clear();
+	_memory.clear();
+}
+
+void trust_fit_cache::remember(const entry& e)
+{
+	auto it = _memory.find(e.key);
+	if (it != _memory.end())
+	{
+		_lru.splice(_lru.begin(), _lru, it->second);
+		*it->second = e;
+		return;
+	}
+	if (_capacity == 0) return;
+
+	if (_memory.size() >= _capacity)
+	{
+		_memory.erase(_lru.back().key);
+		_lru.pop_back();
+	}
+	_lru.push_front(e);
+	_memory[e.key] = _lru.begin();
+}
+
+bool trust_fit_cache::read_record(int64 offset, entry& e)
+{
+	// Records appended since the last read are still in the writer's buffer
+	if (_unflushed)
+	{
+		_writer->Flush();
+		_unflushed = false;
+	}
+
+	uint64 record[RECORD_WORDS];
+	if (!_reader->Seek(offset) || !_reader->Read(reinterpret_cast<uint8*>(record), RECORD_BYTES)) return false;
+	e.key = record[0];
+	std::memcpy(e.x, record + 1, sizeof(e.x));
+	std::memcpy(&e.logl, record + 5, sizeof(double));
+	e.numevals = static_cast<int>(record[6]);
+	return checksum(record) == record[7];
+}
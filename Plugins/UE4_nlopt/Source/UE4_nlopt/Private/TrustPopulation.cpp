@@ -0,0 +1,123 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TrustPopulation.h"
+#include "TrustFit.h"
+#include "Async/ParallelFor.h"
+#include <cmath>
+
+trust_population_fit::trust_population_fit()
+	: maxeval(200), ftol_rel(1e-6), rounds(3),
+	  _histories(nullptr), _num_participants(0), _log_posterior(0.)
+{
+	const double sd0[4] = { 20., 20., 2., 2. };
+	const double sd_floor[4] = { 1., 1., 0.1, 0.1 };
+	for (int k = 0; k < 4; k++)
+	{
+		prior_sd[k] = sd0[k];
+		min_sd[k] = sd_floor[k];
+		_sd[k] = sd0[k];
+	}
+}
+
+bool trust_population_fit::fit(const std::vector<trust_history>& histories)
+{
+	_histories = &histories;
+	_num_participants = histories.size();
+	const size_t J = _num_participants;
+	const unsigned n = static_cast<unsigned>(4 * (J + 1));
+	if (J == 0) return false;
+
+	// Start each participant where AOptimizer would, mu at their mean
+	_x.assign(n, 0.);
+	double* mu = _x.data() + 4 * J;
+	for (size_t j = 0; j < J; j++)
+	{
+		double* xj = _x.data() + 4 * j;
+		trust_initial_guess(histories[j].trust_feedback.empty() ? 50 : histories[j].trust_feedback[0], xj);
+		for (int k = 0; k < 4; k++) mu[k] += xj[k] / J;
+	}
+	for (int k = 0; k < 4; k++) _sd[k] = prior_sd[k];
+
+	nlopt::opt opt(nlopt::LD_LBFGS, n);
+	std::vector<double> lb(n), ub(n);
+	for (unsigned i = 0; i < n; i++)
+	{
+		lb[i] = trust_lb[i % 4];
+		ub[i] = trust_ub[i % 4];
+	}
+	opt.set_lower_bounds(lb);
+	opt.set_upper_bounds(ub);
+	opt.set_maxeval(maxeval);
+	opt.set_ftol_rel(ftol_rel);
+	opt.set_max_objective_typed(*this);
+
+	bool ok = true;
+	for (int round = 0; round < rounds; round++)
+	{
+		// Running out of evaluations returns normally. Roundoff and a forced
+		// stop keep the last point; anything else fails the fit, whichever
+		// round it happens in.
+		try {
+			opt.optimize(_x, _log_posterior);
+		}
+		catch (const nlopt::roundoff_limited&) {
+		}
+		catch (const nlopt::forced_stop&) {
+		}
+		catch (...) {
+			ok = false;
+		}
+
+		// Empirical Bayes update of the prior spread
+		mu = _x.data() + 4 * J;
+		for (int k = 0; k < 4; k++)
+		{
+			double ss = 0.;
+			for (size_t j = 0; j < J; j++)
+			{
+				const double d = _x[4 * j + k] - mu[k];
+				ss += d * d;
+			}
+			const double sd = std::sqrt(ss / J);
+			_sd[k] = sd > min_sd[k] ? sd : min_sd[k];
+		}
+	}
+	return ok;
+}
+
+double trust_population_fit::operator()(unsigned n, const double* x, double* grad) const
+{
+	const size_t J = _num_participants;
+	const double* mu = x + 4 * J;
+
+	// Per participant: likelihood and prior for its own block, and its
+	// contribution to the mu gradient
+	std::vector<trust_partial> parts(J);
+	ParallelFor(static_cast<int32>(J), [&](int32 j)
+	{
+		const trust_history& h = (*_histories)[j];
+		trust_objective objective;
+		objective.performance = &h.performance;
+		objective.trust_feedback = &h.trust_feedback;
+
+		const double* xj = x + 4 * j;
+		double* gj = grad ? grad + 4 * j : nullptr;
+		trust_partial& part = parts[j];
+		part.logl = objective(4, xj, gj);
+		for (int k = 0; k < 4; k++)
+		{
+			const double z = (xj[k] - mu[k]) / (_sd[k] * _sd[k]);
+			part.logl -= 0.5 * z * (xj[k] - mu[k]);
+			part.grad[k] = z;
+			if (gj) gj[k] -= z;
+		}
+	});
+
+	const trust_partial total = trust_objective::pairwise_sum(parts.data(), J);
+	if (grad)
+	{
+		for (int k = 0; k < 4; k++) grad[4 * J + k] = total.grad[k];
+	}
+	return total.logl;
+}
@@ -0,0 +1,250 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TrustSolver.h"
+#include <cmath>
+
+trust_solver::trust_solver()
+	: _maxeval(15), _xtol_rel(1e-1), _ftol_rel(1e-1), _ftol_abs(1e-4),
+	  _phase(phase::idle), _numevals(0), _f(HUGE_VAL), _step(1.), _tries(0),
+	  _best_f(HUGE_VAL), _mem_count(0), _mem_head(0)
+{
+	_objective.performance = nullptr;
+	_objective.trust_feedback = nullptr;
+	for (int i = 0; i < DIM; i++)
+	{
+		_lb[i] = -HUGE_VAL;
+		_ub[i] = HUGE_VAL;
+		_x[i] = _g[i] = _d[i] = _best_x[i] = 0.;
+	}
+}
+
+void trust_solver::set_bounds(const double* lb, const double* ub)
+{
+	for (int i = 0; i < DIM; i++)
+	{
+		_lb[i] = lb[i];
+		_ub[i] = ub[i];
+	}
+}
+
+void trust_solver::set_stopping(int maxeval, double xtol_rel, double ftol_rel, double ftol_abs)
+{
+	_maxeval = maxeval;
+	_xtol_rel = xtol_rel;
+	_ftol_rel = ftol_rel;
+	_ftol_abs = ftol_abs;
+}
+
+void trust_solver::start(const double* x0, const std::vector<int>* performance, const std::vector<int>* trust_feedback)
+{
+	_objective.performance = performance;
+	_objective.trust_feedback = trust_feedback;
+	_objective.history = nullptr;
+	restart(x0);
+}
+
+void trust_solver::start(const double* x0, const trust_compact_history* history)
+{
+	_objective.performance = nullptr;
+	_objective.trust_feedback = nullptr;
+	_objective.history = history;
+	restart(x0);
+}
+
+void trust_solver::restart(const double* x0)
+{
+	for (int i = 0; i < DIM; i++) _x[i] = x0[i];
+	project(_x);
+	for (int i = 0; i < DIM; i++) _best_x[i] = _x[i];
+	_best_f = HUGE_VAL;
+
+	_numevals = 0;
+	_mem_count = 0;
+	_mem_head = 0;
+	_phase = phase::first_eval;
+}
+
+bool trust_solver::run(double budget_us)
+{
+	const double deadline = FPlatformTime::Seconds() + budget_us * 1e-6;
+	do
+	{
+		step();
+	} while (_phase == phase::trial && FPlatformTime::Seconds() < deadline);
+	return finished();
+}
+
+// One objective evaluation and the state transition that follows it
+void trust_solver::step()
+{
+	if (_phase != phase::first_eval && _phase != phase::trial) return;
+	if (_maxeval > 0 && _numevals >= _maxeval)
+	{
+		_phase = phase::done;
+		return;
+	}
+
+	if (_phase == phase::first_eval)
+	{
+		_f = evaluate(_x, _g);
+		if (!std::isfinite(_f))
+		{
+			_phase = phase::done;
+			return;
+		}
+		next_direction();
+		return;
+	}
+
+	// Trial point of the backtracking line search
+	double xn[DIM], gn[DIM];
+	double decrease = 0.;
+	for (int i = 0; i < DIM; i++) xn[i] = _x[i] + _step * _d[i];
+	project(xn);
+	for (int i = 0; i < DIM; i++) decrease += _g[i] * (xn[i] - _x[i]);
+
+	const double fn = evaluate(xn, gn);
+
+	// Armijo condition, also rejects NaN
+	if (!(fn <= _f + 1e-4 * decrease))
+	{
+		_step *= 0.5;
+		if (++_tries >= MAX_TRIES) _phase = phase::done;
+		return;
+	}
+
+	// Accept and remember the curvature pair
+	double* s = _s[_mem_head];
+	double* y = _y[_mem_head];
+	double sy = 0.;
+	bool xconv = true;
+	for (int i = 0; i < DIM; i++)
+	{
+		s[i] = xn[i] - _x[i];
+		y[i] = gn[i] - _g[i];
+		sy += s[i] * y[i];
+		if (std::fabs(s[i]) > _xtol_rel * std::fabs(xn[i])) xconv = false;
+	}
+	if (sy > 1e-12)
+	{
+		_rho[_mem_head] = 1. / sy;
+		_mem_head = (_mem_head + 1) % MEM;
+		if (_mem_count < MEM) _mem_count++;
+	}
+
+	const double df = std::fabs(fn - _f);
+	const bool fconv = df <= _ftol_abs || df <= _ftol_rel * std::fabs(fn);
+
+	for (int i = 0; i < DIM; i++)
+	{
+		_x[i] = xn[i];
+		_g[i] = gn[i];
+	}
+	_f = fn;
+
+	if (xconv || fconv)
+	{
+		_phase = phase::done;
+		return;
+	}
+	next_direction();
+}
+
+// L-BFGS two-loop recursion over the free variables
+void trust_solver::next_direction()
+{
+	double q[DIM];
+	double qnorm = 0.;
+	for (int i = 0; i < DIM; i++)
+	{
+		q[i] = is_fixed(i) ? 0. : _g[i];
+		qnorm += q[i] * q[i];
+	}
+	if (qnorm == 0.)
+	{
+		// Projected gradient vanishes, nothing left to do
+		_phase = phase::done;
+		return;
+	}
+
+	double alpha[MEM];
+	for (int j = 0; j < _mem_count; j++)
+	{
+		const int k = (_mem_head - 1 - j + MEM) % MEM;
+		double sq = 0.;
+		for (int i = 0; i < DIM; i++) sq += _s[k][i] * q[i];
+		alpha[j] = _rho[k] * sq;
+		for (int i = 0; i < DIM; i++) q[i] -= alpha[j] * _y[k][i];
+	}
+
+	// Initial scaling: curvature of the newest pair, unit step otherwise
+	double gamma = 1. / std::sqrt(qnorm);
+	if (_mem_count > 0)
+	{
+		const int k = (_mem_head - 1 + MEM) % MEM;
+		double yy = 0.;
+		for (int i = 0; i < DIM; i++) yy += _y[k][i] * _y[k][i];
+		gamma = 1. / (_rho[k] * yy);
+	}
+	for (int i = 0; i < DIM; i++) q[i] *= gamma;
+
+	for (int j = _mem_count - 1; j >= 0; j--)
+	{
+		const int k = (_mem_head - 1 - j + MEM) % MEM;
+		double yr = 0.;
+		for (int i = 0; i < DIM; i++) yr += _y[k][i] * q[i];
+		const double beta = _rho[k] * yr;
+		for (int i = 0; i < DIM; i++) q[i] += _s[k][i] * (alpha[j] - beta);
+	}
+
+	double dg = 0.;
+	for (int i = 0; i < DIM; i++)
+	{
+		_d[i] = is_fixed(i) ? 0. : -q[i];
+		dg += _d[i] * _g[i];
+	}
+
+	// Not a descent direction: drop the memory and use steepest descent
+	if (!(dg < 0.))
+	{
+		_mem_count = 0;
+		const double scale = 1. / std::sqrt(qnorm);
+		for (int i = 0; i < DIM; i++) _d[i] = is_fixed(i) ? 0. : -_g[i] * scale;
+	}
+
+	_step = 1.;
+	_tries = 0;
+	_phase = phase::trial;
+}
+
+// Negated log-likelihood and gradient, tracking the best point
+double trust_solver::evaluate(const double* x, double* grad)
+{
+	const double logl = _objective(DIM, x, grad);
+	for (int i = 0; i < DIM; i++) grad[i] = -grad[i];
+	_numevals++;
+
+	const double f = -logl;
+	if (f < _best_f)
+	{
+		_best_f = f;
+		for (int i = 0; i < DIM; i++) _best_x[i] = x[i];
+	}
+	return f;
+}
+
+void trust_solver::project(double* x) const
+{
+	for (int i = 0; i < DIM; i++)
+	{
+		if (x[i] < _lb[i]) x[i] = _lb[i];
+		if (x[i] > _ub[i]) x[i] = _ub[i];
+	}
+}
+
+// At a bound with the gradient pointing out of the box
+bool trust_solver::is_fixed(int i) const
+{
+	return (_x[i] <= _lb[i] && _g[i] > 0.) || (_x[i] >= _ub[i] && _g[i] < 0.);
+}
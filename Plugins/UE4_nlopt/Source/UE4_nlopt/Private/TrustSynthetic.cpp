@@ -0,0 +1,156 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TrustSynthetic.h"
+#include "Async/ParallelFor.h"
+#include <cmath>
+
+// Uniform in (0, 1]
+static double sample_open(FRandomStream& rng)
+{
+	return 1. - rng.FRand();
+}
+
+static double sample_normal(FRandomStream& rng)
+{
+	// Box-Muller, one of the pair
+	const double r = std::sqrt(-2. * std::log(sample_open(rng)));
+	return r * std::cos(2. * PI * rng.FRand());
+}
+
+static double sample_gamma(FRandomStream& rng, double shape)
+{
+	// Boost below 1: Gamma(a) = Gamma(a + 1) U^(1 / a)
+	if (shape < 1.)
+	{
+		return sample_gamma(rng, shape + 1.) * std::pow(sample_open(rng), 1. / shape);
+	}
+
+	const double d = shape - 1. / 3.;
+	const double c = 1. / std::sqrt(9. * d);
+	for (;;)
+	{
+		double z, v;
+		do
+		{
+			z = sample_normal(rng);
+			v = 1. + c * z;
+		} while (v <= 0.);
+		v = v * v * v;
+		const double u = sample_open(rng);
+		if (u < 1. - 0.0331 * z * z * z * z) return d * v;
+		if (std::log(u) < 0.5 * z * z + d * (1. - v + std::log(v))) return d * v;
+	}
+}
+
+double trust_sample_beta(FRandomStream& rng, double a, double b)
+{
+	const double ga = sample_gamma(rng, a);
+	const double gb = sample_gamma(rng, b);
+	return ga / (ga + gb);
+}
+
+void trust_synthesize(const trust_synthetic_config& config, int j, double x[4], trust_history& history)
+{
+	FRandomStream rng(static_cast<int32>(HashCombine(config.seed, static_cast<uint32>(j))));
+
+	for (int k = 0; k < 4; k++)
+	{
+		x[k] = config.x[k];
+		if (config.spread > 0.) x[k] *= std::exp(config.spread * sample_normal(rng));
+		x[k] = FMath::Clamp(x[k], trust_lb[k], trust_ub[k]);
+	}
+
+	const int num_sites = config.max_sites > config.min_sites
+		? rng.RandRange(config.min_sites, config.max_sites) : config.min_sites;
+	history.performance.resize(num_sites);
+	history.trust_feedback.resize(num_sites);
+
+	double alpha = x[0];
+	double beta = x[1];
+	for (int i = 0; i < num_sites; i++)
+	{
+		const int p = rng.FRand() < config.success_rate ? 1 : 0;
+		alpha += p * x[2];
+		beta += (1 - p) * x[3];
+		const double t = trust_sample_beta(rng, alpha, beta);
+		history.performance[i] = p;
+		history.trust_feedback[i] = FMath::Clamp(static_cast<int>(t * 100. + 0.5), 0, 100);
+	}
+}
+
+void trust_synthesize_study(const trust_synthetic_config& config, std::vector<trust_history>& histories,
+							std::vector<double>* truth)
+{
+	const int J = FMath::Max(config.num_participants, 0);
+	histories.resize(J);
+	if (truth) truth->resize(4 * J);
+
+	ParallelFor(J, [&](int32 j)
+	{
+		double x[4];
+		trust_synthesize(config, j, x, histories[j]);
+		if (truth)
+		{
+			for (int k = 0; k < 4; k++) (*truth)[4 * j + k] = x[k];
+		}
+	});
+}
+
+trust_recovery trust_check_recovery(const trust_synthetic_config& config, const trust_profile& profile)
+{
+	trust_recovery r;
+	std::vector<trust_history> histories;
+	std::vector<double> truth;
+	trust_synthesize_study(config, histories, &truth);
+
+	const int J = static_cast<int>(histories.size());
+	if (J == 0) return r;
+
+	std::vector<double> estimates(4 * J);
+	std::vector<int> evals(J, 0);
+	std::vector<double> trajectory_error(J, 0.);
+	std::vector<int> trajectory_sites(J, 0);
+
+	const double start = FPlatformTime::Seconds();
+	ParallelFor(J, [&](int32 j)
+	{
+		const trust_history& h = histories[j];
+		const int N = static_cast<int>(h.performance.size());
+		double* x = &estimates[4 * j];
+
+		trust_initial_guess(N > 0 ? h.trust_feedback[0] : 50, x);
+		if (N < 2) return;
+
+		trust_fit(h.performance, h.trust_feedback, profile, x, &evals[j]);
+
+		std::vector<double> fitted(N), actual(N);
+		trust_trajectory(h.performance, x, fitted.data());
+		trust_trajectory(h.performance, &truth[4 * j], actual.data());
+		for (int i = 0; i < N; i++) trajectory_error[j] += FMath::Abs(fitted[i] - actual[i]);
+		trajectory_sites[j] = N;
+	});
+	r.seconds = FPlatformTime::Seconds() - start;
+
+	int num_sites = 0;
+	for (int j = 0; j < J; j++)
+	{
+		for (int k = 0; k < 4; k++)
+		{
+			const double e = estimates[4 * j + k] - truth[4 * j + k];
+			r.bias[k] += e;
+			r.rmse[k] += e * e;
+		}
+		r.mean_evals += evals[j];
+		r.trajectory_mae += trajectory_error[j];
+		num_sites += trajectory_sites[j];
+	}
+	for (int k = 0; k < 4; k++)
+	{
+		r.bias[k] /= J;
+		r.rmse[k] = std::sqrt(r.rmse[k] / J);
+	}
+	r.mean_evals /= J;
+	if (num_sites > 0) r.trajectory_mae /= num_sites;
+	return r;
+}
@@ -0,0 +1,233 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TrustTuner.h"
+#include "Async/ParallelFor.h"
+#include <algorithm>
+#include <cmath>
+
+// Trust estimate after the last site of the prefix
+static double final_trust(const std::vector<int>& performance, const double x[4])
+{
+	int ns = 0;
+	for (int p : performance) ns += p;
+	const int nf = static_cast<int>(performance.size()) - ns;
+	const double alpha = x[0] + ns * x[2];
+	const double beta = x[1] + nf * x[3];
+	return alpha / (alpha + beta);
+}
+
+// Online replay of one history. trust[i] is the estimate after update i;
+// when seconds is set, each update's wall time is stored there too.
+static void replay(const trust_history& history, const trust_profile& profile,
+				   double* trust, double* seconds, int* numevals)
+{
+	std::vector<int> performance, trust_feedback;
+	performance.reserve(history.performance.size());
+	trust_feedback.reserve(history.trust_feedback.size());
+
+	nlopt::opt opt = trust_configure(profile);
+	trust_objective objective;
+	objective.performance = &performance;
+	objective.trust_feedback = &trust_feedback;
+	objective._opt = &opt;
+	objective._max_evals = profile.max_evals;
+	trust_reparameterized<trust_objective> reparameterized;
+	trust_bind_objective(opt, profile, objective, reparameterized);
+
+	std::vector<double> x(4);
+	for (size_t i = 0; i < history.performance.size(); i++)
+	{
+		performance.push_back(history.performance[i]);
+		trust_feedback.push_back(history.trust_feedback[i]);
+
+		const double start = FPlatformTime::Seconds();
+		if (i == 0)
+		{
+			trust_initial_guess(trust_feedback.back(), x.data());
+		}
+		else
+		{
+			double logl;
+			if (profile.reparameterize) trust_to_unconstrained(x.data());
+			try {
+				opt.optimize(x, logl);
+			}
+			catch (...) {
+				// Keep the last point, as UpdateParameters does
+			}
+			if (profile.reparameterize) trust_from_unconstrained(x.data());
+			if (numevals) *numevals += opt.get_numevals();
+		}
+		if (seconds) seconds[i] = FPlatformTime::Seconds() - start;
+		trust[i] = final_trust(performance, x.data());
+	}
+}
+
+trust_profile_tuner::trust_profile_tuner()
+	: algorithms({ nlopt::LD_LBFGS, nlopt::LD_MMA, nlopt::LD_SLSQP, nlopt::LD_TNEWTON_PRECOND_RESTART, nlopt::LD_VAR2 }),
+	  maxevals({ 5, 10, 15, 25, 50 }),
+	  eval_caps({ 0, 5, 10 }),
+	  xtols({ 1e-1, 1e-2, 1e-3 }),
+	  ftols({ 1e-1, 1e-2, 1e-4 }),
+	  abs_ftols({ 1e-2, 1e-4, 1e-6 }),
+	  reparameterizations({ false }),
+	  timing_runs(1), max_deviation(0.01), _recommended(0)
+{
+}
+
+bool trust_profile_tuner::run(const std::vector<trust_history>& histories)
+{
+	_points.clear();
+	_recommended = 0;
+
+	const size_t J = histories.size();
+	std::vector<size_t> offset(J + 1, 0);
+	for (size_t j = 0; j < J; j++) offset[j + 1] = offset[j] + histories[j].performance.size();
+	const size_t num_updates = offset[J];
+	if (num_updates == 0) return false;
+
+	// Converged reference estimate after every update
+	std::vector<double> reference(num_updates);
+	const trust_profile converged = trust_profile::converged();
+	ParallelFor(static_cast<int32>(J), [&](int32 j)
+	{
+		replay(histories[j], converged, &reference[offset[j]], nullptr, nullptr);
+	});
+
+	for (nlopt::algorithm algorithm : algorithms)
+	for (int maxeval : maxevals)
+	for (int eval_cap : eval_caps)
+	for (double xtol : xtols)
+	for (double ftol : ftols)
+	for (double ftol_abs : abs_ftols)
+	for (bool reparameterize : reparameterizations)
+	{
+		// A cap at or above maxeval never triggers
+		if (eval_cap >= maxeval) continue;
+
+		trust_tuning_point point;
+		point.profile.algorithm = algorithm;
+		point.profile.maxeval = maxeval;
+		point.profile.max_evals = eval_cap;
+		point.profile.xtol_rel = xtol;
+		point.profile.ftol_rel = ftol;
+		point.profile.ftol_abs = ftol_abs;
+		point.profile.reparameterize = reparameterize;
+		_points.push_back(point);
+	}
+	if (_points.empty()) return false;
+
+	// Screening: deviation and evaluations of every point, in parallel
+	ParallelFor(static_cast<int32>(_points.size()), [&](int32 k)
+	{
+		trust_tuning_point& point = _points[k];
+		std::vector<double> trust(num_updates);
+		int numevals = 0;
+		for (size_t j = 0; j < J; j++)
+		{
+			replay(histories[j], point.profile, &trust[offset[j]], nullptr, &numevals);
+		}
+
+		double ss = 0.;
+		for (size_t i = 0; i < num_updates; i++)
+		{
+			const double d = trust[i] - reference[i];
+			ss += d * d;
+		}
+		point.deviation = std::sqrt(ss / num_updates);
+		point.mean_evals = static_cast<double>(numevals) / num_updates;
+	});
+
+	// Keep the points no point of the same algorithm and solve form beats
+	// on both evaluations and deviation
+	for (trust_tuning_point& p : _points)
+	{
+		p.timed = true;
+		for (const trust_tuning_point& q : _points)
+		{
+			if (q.profile.algorithm == p.profile.algorithm && q.profile.reparameterize == p.profile.reparameterize &&
+				q.mean_evals <= p.mean_evals && q.deviation <= p.deviation &&
+				(q.mean_evals < p.mean_evals || q.deviation < p.deviation))
+			{
+				p.timed = false;
+				break;
+			}
+		}
+	}
+
+	// Timing of the kept points, one at a time on this thread
+	std::vector<double> trust(num_updates), seconds(num_updates), best_seconds(num_updates);
+	for (trust_tuning_point& point : _points)
+	{
+		if (!point.timed) continue;
+
+		for (int run = 0; run < FMath::Max(timing_runs, 1); run++)
+		{
+			for (size_t j = 0; j < J; j++)
+			{
+				replay(histories[j], point.profile, &trust[offset[j]], &seconds[offset[j]], nullptr);
+			}
+			for (size_t i = 0; i < num_updates; i++)
+			{
+				best_seconds[i] = run == 0 ? seconds[i] : FMath::Min(best_seconds[i], seconds[i]);
+			}
+		}
+
+		double total = 0.;
+		for (size_t i = 0; i < num_updates; i++)
+		{
+			total += best_seconds[i];
+			point.max_latency_us = FMath::Max(point.max_latency_us, best_seconds[i] * 1e6);
+		}
+		point.latency_us = total * 1e6 / num_updates;
+	}
+
+	// Mark the timed points no other timed point beats on both latency and
+	// deviation
+	for (trust_tuning_point& p : _points)
+	{
+		p.pareto = p.timed;
+		if (!p.timed) continue;
+		for (const trust_tuning_point& q : _points)
+		{
+			if (q.timed && q.latency_us <= p.latency_us && q.deviation <= p.deviation &&
+				(q.latency_us < p.latency_us || q.deviation < p.deviation))
+			{
+				p.pareto = false;
+				break;
+			}
+		}
+	}
+
+	size_t fastest = _points.size(), most_accurate = _points.size();
+	for (size_t k = 0; k < _points.size(); k++)
+	{
+		const trust_tuning_point& p = _points[k];
+		if (!p.pareto) continue;
+		if (p.deviation <= max_deviation && (fastest == _points.size() || p.latency_us < _points[fastest].latency_us))
+		{
+			fastest = k;
+		}
+		if (most_accurate == _points.size() || p.deviation < _points[most_accurate].deviation)
+		{
+			most_accurate = k;
+		}
+	}
+	_recommended = fastest < _points.size() ? fastest : most_accurate;
+	return true;
+}
+
+std::vector<trust_tuning_point> trust_profile_tuner::pareto_front() const
+{
+	std::vector<trust_tuning_point> front;
+	for (const trust_tuning_point& p : _points)
+	{
+		if (p.pareto) front.push_back(p);
+	}
+	std::sort(front.begin(), front.end(), [](const trust_tuning_point& a, const trust_tuning_point& b)
+	{
+		return a.latency_us < b.latency_us;
+	});
+	return front;
+}
@@ -5,14 +5,57 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
 #include <nlopt.hpp>
+#include <boost/lockfree/queue.hpp>
 #include <vector>
+#include "TrustObjective.h"
+#include "TrustFit.h"
+#include "TrustSolver.h"
 #include "Optimizer.generated.h"
 
-typedef struct feedback_data {
-	std::vector<int> performance;
-	std::vector<int> trust_feedback;
-	nlopt::opt _opt;
-	int _max_evals;
+// One performance / trust feedback observation, as queued by PostEvent
+struct trust_event
+{
+	int performance;
+	int trust_feedback;
+};
+
+// Blueprint copy of the estimator state. AOptimizer keeps the state itself
+// in double precision; this snapshot is for display and game logic and is
+// never fed back into a solve.
+USTRUCT(BlueprintType)
+struct FTrustEstimate
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly)
+	float alpha0 = 0.f;
+
+	UPROPERTY(BlueprintReadOnly)
+	float beta0 = 0.f;
+
+	UPROPERTY(BlueprintReadOnly)
+	float ws = 0.f;
+
+	UPROPERTY(BlueprintReadOnly)
+	float wf = 0.f;
+
+	// alpha / (alpha + beta) after the last site
+	UPROPERTY(BlueprintReadOnly)
+	float trust = 0.f;
+
+	// Of the last solve, 0 if it came from the fit cache or no solve ran yet
+	UPROPERTY(BlueprintReadOnly)
+	float log_likelihood = 0.f;
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 num_evals = 0;
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 num_sites = 0;
+
+	// False until the first observation
+	UPROPERTY(BlueprintReadOnly)
+	bool valid = false;
 };
 
 UCLASS()
@@ -32,23 +75,162 @@ public:
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
 
+	// Add the observation and refit, warm-started from the estimator's own
+	// double precision estimate. Nothing has to be carried in Blueprint
+	// variables between calls.
+	UFUNCTION(BlueprintCallable)
+	FTrustEstimate Update(int performance, int trust_feedback);
+
+	UFUNCTION(BlueprintCallable, BlueprintPure)
+	FTrustEstimate GetEstimate() const;
+
+	// The float update. The last parameters passed in are only a hint: if
+	// they are the float copy of the stored estimate, the solve starts from
+	// the stored double values, so round trips through Blueprint lose
+	// nothing. Any other values start the solve where they say.
 	UFUNCTION(BlueprintCallable)
 	void UpdateParameters(int performance, int trust_feedback, float alpha0_last, float beta0_last, float ws_last, float wf_last,
 						 float& alpha0, float& beta0, float& ws, float& wf);
 
+	// Same update, but queued with the world's UTrustEstimationSubsystem and
+	// solved together with the other actors' updates at the end of the
+	// frame. The result is published in alpha0_best, beta0_best, ws_best
+	// and wf_best.
+	UFUNCTION(BlueprintCallable)
+	void RequestUpdate(int performance, int trust_feedback, float alpha0_last, float beta0_last, float ws_last, float wf_last);
+
+	// Same update, but solved a slice at a time over the following ticks,
+	// spending at most frame_budget_us per frame. The best parameters so far
+	// are published in alpha0_best, beta0_best, ws_best and wf_best.
+	UFUNCTION(BlueprintCallable)
+	void StartTimeSlicedUpdate(int performance, int trust_feedback, float alpha0_last, float beta0_last, float ws_last, float wf_last);
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float frame_budget_us;
+
+	UPROPERTY(BlueprintReadOnly)
+	bool solve_in_progress;
+
+	UPROPERTY(BlueprintReadOnly)
+	float alpha0_best;
+
+	UPROPERTY(BlueprintReadOnly)
+	float beta0_best;
+
+	UPROPERTY(BlueprintReadOnly)
+	float ws_best;
+
+	UPROPERTY(BlueprintReadOnly)
+	float wf_best;
+
+	// Queue an observation from any thread, without touching the history
+	UFUNCTION(BlueprintCallable)
+	void PostEvent(int performance, int trust_feedback);
+
+	// Move all queued observations into the history and refit once for the
+	// whole batch. Returns false, leaving the outputs alone, if nothing was queued.
+	UFUNCTION(BlueprintCallable)
+	bool UpdateFromEvents(float alpha0_last, float beta0_last, float ws_last, float wf_last,
+						  float& alpha0, float& beta0, float& ws, float& wf);
+
+	// Population-level parameters, e.g. the mean of a trust_population_fit,
+	// used by GetInitialGuess in place of the fixed defaults
+	UFUNCTION(BlueprintCallable)
+	void SetPopulationPrior(float alpha0, float beta0, float ws, float wf);
+
+	// Reuse fits of an identical history, starting point and profile from
+	// the process-wide trust_fit_cache, e.g. when a study is re-run
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool use_fit_cache;
+
+	// Back the fit cache with a file, so re-runs in later sessions only
+	// solve new or changed data. Fails on a file written by another
+	// version of the trust model.
+	UFUNCTION(BlueprintCallable)
+	static bool OpenFitCache(const FString& path);
+
 	UFUNCTION(BlueprintCallable)
 	float GetTrustEstimate(float alpha0, float beta0, float ws, float wf);
 
 	UFUNCTION(BlueprintCallable)
 	void reset();
 
-	std::vector<int> performance_history;
-	std::vector<int> _trust_feedback;
+	// Observations so far, a bit per outcome and a byte per feedback
+	trust_compact_history history;
 	int MAX_EVAL;
 
-private:
+	// Full precision estimate, valid once HasEstimate
+	bool HasEstimate() const { return _has_estimate; }
+	const double* GetParameters() const { return _x; }
+
+	// Gradient of the log-likelihood at the estimate, with respect to
+	// (alpha0, beta0, ws, wf)
+	void GetGradient(double grad[4]) const;
+
+	// Algorithm and stopping criteria of every update
+	const trust_profile& GetProfile() const { return _profile; }
+	void SetProfile(const trust_profile& profile);
+
+	void AddSample(int performance, int trust_feedback);
+
+	// Append a recorded history in one call, without fitting
+	void AddSamples(TArrayView<const int> performance, TArrayView<const int> trust_feedback);
+
+	// Run the online update over a recorded history from an empty one, as
+	// calling Update once per site would. estimates[i] is the trust
+	// estimate after site i.
+	void Replay(TArrayView<const int> performance, TArrayView<const int> trust_feedback, TArray<float>& estimates);
+
+	// Append the queued observations to the history, returns how many.
+	// Single consumer: only call from the thread that owns the history.
+	int DrainEvents();
+
+	// Fit the parameters to the current history, starting from the last
+	// estimate. Only touches this actor, so different actors can be solved
+	// on different threads.
+	void Solve(float alpha0_last, float beta0_last, float ws_last, float wf_last,
+			   float& alpha0, float& beta0, float& ws, float& wf);
+
 	void GetInitialGuess(int trust_feedback, float& alpha0, float& beta0, float& ws, float& wf);
-};
 
-double Objective(const std::vector<double>& x, std::vector<double>& grad, void* func_data);
+private:
+	void SetupOptimizer();
+
+	// x0 for a solve from the last parameters given in float
+	void WarmStart(float alpha0_last, float beta0_last, float ws_last, float wf_last, double x0[4]) const;
+	// Solve from x0 and store the result as the estimate
+	void SolveFrom(std::vector<double>& x0);
+	void SetEstimate(const double x[4], double logl, int numevals);
+	void PublishBest();
+	void StopTimeSlicedUpdate();
+
+	trust_profile _profile;
 
+	// Configured once, each update only swaps the initial guess
+	nlopt::opt _opt;
+	trust_objective _objective;
+	trust_reparameterized<trust_objective> _reparameterized;
+	bool _opt_ready;
+
+	// Content hash of the history, the fit cache key
+	uint64 _history_hash;
+
+	// Estimator state in double precision: the last estimate, the
+	// log-likelihood there and the evaluations the solve took
+	double _x[4];
+	bool _has_estimate;
+	double _logl;
+	int _numevals;
+
+	// Warm start from SetPopulationPrior
+	bool _has_prior;
+	float _prior[4];
+
+	// Resumable solver behind StartTimeSlicedUpdate
+	trust_solver _solver;
+
+	// Observations posted from other threads, multi-producer single-consumer.
+	// Sized here, since the queue has no default constructor and UHT also
+	// generates a constructor that default-initializes the members.
+	boost::lockfree::queue<trust_event> _events{ 256 };
+};
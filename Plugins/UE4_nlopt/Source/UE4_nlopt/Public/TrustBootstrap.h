@@ -0,0 +1,56 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TrustFit.h"
+#include <vector>
+
+struct trust_interval
+{
+	double lo;
+	double hi;
+};
+
+// Parametric bootstrap percentile intervals for one participant's fit.
+// Sites cannot be resampled independently, since the model accumulates
+// over the sequence, so each replicate keeps the performance history and
+// redraws the feedback from Beta(alpha0 + ns ws, beta0 + nf wf) at the
+// full-data estimate. Each replicate is fitted in parallel, warm-started
+// from the full-data fit.
+// Replicate b draws from its own stream seeded by (seed, b), so the
+// results do not depend on the thread count.
+class UE4_NLOPT_API trust_bootstrap
+{
+public:
+	trust_bootstrap();
+
+	int replicates;
+	double level;
+	uint32 seed;
+	trust_profile profile;
+
+	// Fit the full history from x_start, then the replicates.
+	// Returns false if there is too little data.
+	bool run(const std::vector<int>& performance, const std::vector<int>& trust_feedback, const double x_start[4]);
+
+	// Full-data estimate
+	const double* estimate() const { return _estimate; }
+
+	// Interval for parameter k of (alpha0, beta0, ws, wf)
+	trust_interval parameter_interval(int k) const { return _parameter_intervals[k]; }
+
+	// Full-data trust trajectory over the original history and its interval at each site
+	const std::vector<double>& trajectory() const { return _trajectory; }
+	const std::vector<trust_interval>& trajectory_intervals() const { return _trajectory_intervals; }
+
+	// Replicate estimates, 4 per replicate
+	const std::vector<double>& replicate_estimates() const { return _replicates; }
+
+private:
+	double _estimate[4];
+	trust_interval _parameter_intervals[4];
+	std::vector<double> _trajectory;
+	std::vector<trust_interval> _trajectory_intervals;
+	std::vector<double> _replicates;
+};
@@ -0,0 +1,80 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TrustFit.h"
+#include "TrustPopulation.h"
+#include <vector>
+
+// Fold-independent per-site terms of one history: the clamped log feedback
+// and the success / failure counts up to and including each site
+struct trust_site_terms
+{
+	std::vector<double> logt;
+	std::vector<double> log1t;
+	std::vector<double> t;
+	std::vector<int> ns;
+	std::vector<int> nf;
+
+	void build(const trust_history& history);
+	size_t size() const { return logt.size(); }
+};
+
+// trust_objective over the sites outside one fold. The held-out sites still
+// advance alpha and beta through their performance, only their feedback is
+// left out of the likelihood.
+struct trust_fold_objective
+{
+	const trust_site_terms* terms;
+	const std::vector<int>* fold_of_site;
+	int held_out;
+
+	nlopt::opt* _opt = nullptr;
+	int _max_evals = 0;
+
+	double operator()(unsigned n, const double* x, double* grad) const;
+};
+
+// Predictive accuracy of the trust estimate on held-out feedback
+struct trust_cv_score
+{
+	// Log-likelihood of the held-out feedback
+	double logl = 0.;
+	// Root mean square error of alpha / (alpha + beta) against feedback / 100
+	double rmse = 0.;
+	int num_heldout = 0;
+	int numevals = 0;
+};
+
+// k-fold cross-validation over a study. Site i of a history is in fold
+// i % num_folds, so each fold spans the whole mission; num_folds = 0 is
+// leave-one-out. The per-site terms are computed once per participant
+// and shared by all of its folds. Every participant is first fitted on
+// all of its data; the folds differ from that fit by a 1 / num_folds share
+// of the sites, so it is the warm start of each of them, and all
+// (participant, fold) pairs are then fitted in one ParallelFor.
+class UE4_NLOPT_API trust_cross_validation
+{
+public:
+	trust_cross_validation();
+
+	int num_folds;
+	trust_profile profile;
+
+	// Initial guess of the full-data fits, as AOptimizer::GetInitialGuess
+	// when left unset
+	bool has_x_start;
+	double x_start[4];
+
+	// Returns false if no participant has a site to hold out
+	bool run(const std::vector<trust_history>& histories);
+
+	const trust_cv_score& participant(size_t j) const { return _participants[j]; }
+	const trust_cv_score& aggregate() const { return _aggregate; }
+	size_t num_participants() const { return _participants.size(); }
+
+private:
+	std::vector<trust_cv_score> _participants;
+	trust_cv_score _aggregate;
+};
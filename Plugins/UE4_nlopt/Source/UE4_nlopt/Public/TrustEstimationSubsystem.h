@@ -0,0 +1,44 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "TrustEstimationSubsystem.generated.h"
+
+class AOptimizer;
+
+// Per-world scheduler for trust parameter updates. Actors submit updates
+// through AOptimizer::RequestUpdate. Updates are coalesced per actor, and
+// once per frame all pending actors are solved as one parallel batch. The
+// results are published on the game thread before the next frame.
+UCLASS()
+class UE4_NLOPT_API UTrustEstimationSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	// Add the sample to the actor's history and queue a refit from the given
+	// estimate. Several submissions for one actor in a frame share one solve.
+	void Submit(AOptimizer* optimizer, int performance, int trust_feedback, float alpha0_last, float beta0_last, float ws_last, float wf_last);
+
+	// Solve everything pending now, called from Tick
+	void Flush();
+
+	// FTickableGameObject
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+
+private:
+	struct pending_update
+	{
+		TWeakObjectPtr<AOptimizer> optimizer;
+		float x0[4];
+		float x[4];
+	};
+
+	TArray<pending_update> _pending;
+};
@@ -0,0 +1,144 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TrustObjective.h"
+#include <vector>
+
+// Solver settings of one trust fit. The defaults are the settings that
+// AOptimizer::UpdateParameters uses online unless replaced with
+// AOptimizer::SetProfile, e.g. by the recommendation of a
+// trust_profile_tuner.
+struct trust_profile
+{
+	nlopt::algorithm algorithm = nlopt::LD_LBFGS;
+	int maxeval = 15;
+	// Objective-side evaluation cap (AOptimizer::MAX_EVAL), 0 for none
+	int max_evals = 10;
+	double xtol_rel = 1e-1;
+	double ftol_rel = 1e-1;
+	double ftol_abs = 1e-4;
+
+	// Solve over the unconstrained z of trust_to_unconstrained, without
+	// bounds, instead of over the bounded parameters. xtol_rel then also
+	// applies as an absolute tolerance on z, which near a lower bound is a
+	// relative tolerance on x - lb.
+	bool reparameterize = false;
+
+	// Tight settings for reference fits
+	static trust_profile converged()
+	{
+		trust_profile p;
+		p.maxeval = 1000;
+		p.max_evals = 0;
+		p.xtol_rel = 1e-8;
+		p.ftol_rel = 1e-12;
+		p.ftol_abs = 0.;
+		return p;
+	}
+};
+
+// Starting point of a participant's first fit, from their first trust
+// feedback (0-100): prior strength 100 split by the feedback, kept off the
+// ends, with ws = 1 and wf = 2. AOptimizer::GetInitialGuess without a
+// population prior, and every offline fit that mirrors it.
+inline void trust_initial_guess(int first_feedback, double x[4])
+{
+	x[0] = first_feedback;
+	if (x[0] <= 1) x[0] = 1.1;
+	if (x[0] >= 99) x[0] = 98.9;
+	x[1] = 100. - x[0];
+	x[2] = 1.;
+	x[3] = 2.;
+}
+
+// A fresh optimizer with the profile's algorithm, the trust bounds and the
+// profile's stopping criteria. The objective is left to the caller.
+inline nlopt::opt trust_configure(const trust_profile& profile)
+{
+	nlopt::opt opt(profile.algorithm, 4);
+
+	// Set the bounds, the reparameterized problem has none
+	if (!profile.reparameterize)
+	{
+		std::vector<double> lb(trust_lb, trust_lb + 4);
+		std::vector<double> ub(trust_ub, trust_ub + 4);
+		opt.set_lower_bounds(lb);
+		opt.set_upper_bounds(ub);
+	}
+
+	// Stopping criteria
+	opt.set_maxeval(profile.maxeval);
+	opt.set_xtol_rel(profile.xtol_rel);
+	if (profile.reparameterize) opt.set_xtol_abs(profile.xtol_rel);
+	opt.set_ftol_rel(profile.ftol_rel);
+	opt.set_ftol_abs(profile.ftol_abs);
+	return opt;
+}
+
+// Bind objective to opt as the profile solves it: directly, or through
+// reparameterized, which must then stay alive as long as opt uses it.
+// Starting points and results of a reparameterized solve are in z, see
+// trust_to_unconstrained / trust_from_unconstrained.
+template <typename Objective>
+void trust_bind_objective(nlopt::opt& opt, const trust_profile& profile, Objective& objective,
+						  trust_reparameterized<Objective>& reparameterized)
+{
+	reparameterized.objective = &objective;
+	if (profile.reparameterize) opt.set_max_objective_typed<4>(reparameterized);
+	else opt.set_max_objective_typed<4>(objective);
+}
+
+// Fit any objective with the _opt / _max_evals members of trust_objective
+// with a fresh optimizer over the trust bounds, as trust_fit below.
+template <typename Objective>
+nlopt::result trust_fit_objective(Objective& objective, const trust_profile& profile, double x[4], int* numevals = nullptr)
+{
+	nlopt::opt opt = trust_configure(profile);
+
+	objective._opt = &opt;
+	objective._max_evals = profile.max_evals;
+	trust_reparameterized<Objective> reparameterized;
+	trust_bind_objective(opt, profile, objective, reparameterized);
+
+	std::vector<double> x0(x, x + 4);
+	if (profile.reparameterize) trust_to_unconstrained(x0.data());
+	double logl;
+	nlopt::result result;
+	try {
+		result = opt.optimize(x0, logl);
+	}
+	catch (nlopt::forced_stop&) {
+		result = nlopt::FORCED_STOP;
+	}
+	catch (...) {
+		result = nlopt::FAILURE;
+	}
+	objective._opt = nullptr;
+
+	if (profile.reparameterize) trust_from_unconstrained(x0.data());
+	for (int k = 0; k < 4; k++) x[k] = x0[k];
+	if (numevals) *numevals = opt.get_numevals();
+	return result;
+}
+
+// Fit the history with a fresh optimizer. x is the starting point on entry
+// and the estimate on return, which is the last point if the solve stopped
+// early, as in UpdateParameters. Safe to call from several threads.
+UE4_NLOPT_API nlopt::result trust_fit(const std::vector<int>& performance, const std::vector<int>& trust_feedback,
+									  const trust_profile& profile, double x[4], int* numevals = nullptr);
+
+// Global search over the trust bounds: num_starts local fits with the
+// profile, run in parallel, from x on entry and from num_starts - 1 points
+// drawn log-uniformly between trust_lb and trust_ub. Start k draws from
+// its own stream seeded by (seed, k), so the result does not depend on the
+// thread count. x receives the fit with the highest log-likelihood, the
+// earliest start on a tie, and the return value is that log-likelihood.
+// numevals, if given, receives the evaluations of all starts together.
+UE4_NLOPT_API double trust_multistart_fit(const std::vector<int>& performance, const std::vector<int>& trust_feedback,
+										  const trust_profile& profile, int num_starts, uint32 seed, double x[4],
+										  int* numevals = nullptr);
+
+// Trust estimate alpha / (alpha + beta) after each site of the history
+UE4_NLOPT_API void trust_trajectory(const std::vector<int>& performance, const double x[4], double* trust);
@@ -0,0 +1,83 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "TrustFit.h"
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+class IFileHandle;
+
+// Running 64-bit content hash of a (performance, trust feedback) history,
+// extended one site at a time so a prefix costs nothing extra to key
+const uint64 TRUST_HASH_EMPTY = 0xcbf29ce484222325ull;
+UE4_NLOPT_API uint64 trust_hash_site(uint64 hash, int performance, int trust_feedback);
+
+// Cache key of a fit: the history hash, the starting point and the profile
+UE4_NLOPT_API uint64 trust_fit_key(uint64 history_hash, const double x0[4], const trust_profile& profile);
+
+// Fitted parameters, with the log-likelihood and evaluation count of the
+// solve, by fit key. Recent entries live in a bounded LRU list
+// in memory. With a file open, every entry is also appended to it, and a
+// key missed in memory is looked up there and promoted. The file is an
+// index of key -> offset plus fixed-size records, checksummed so a record
+// torn by a crash is skipped. Its header holds the file format and
+// TRUST_MODEL_VERSION, and a file written by another version is not
+// opened. Thread-safe, fits solved in parallel share it.
+class UE4_NLOPT_API trust_fit_cache
+{
+public:
+	explicit trust_fit_cache(size_t capacity = 65536);
+	~trust_fit_cache();
+
+	// Process-wide cache used by AOptimizer
+	static trust_fit_cache& shared();
+
+	// Attach the disk tier, creating the file if needed. Returns false if
+	// the file cannot be opened, is not a fit cache or is of another
+	// format or model version.
+	bool open(const FString& path);
+	void close();
+
+	bool find(uint64 key, double x[4], double& logl, int& numevals);
+	void insert(uint64 key, const double x[4], double logl, int numevals);
+
+	// Drop the memory tier, the file is kept
+	void clear();
+
+	size_t memory_hits() const { return _memory_hits; }
+	size_t disk_hits() const { return _disk_hits; }
+	size_t misses() const { return _misses; }
+
+private:
+	struct entry
+	{
+		uint64 key;
+		double x[4];
+		double logl;
+		int numevals;
+	};
+
+	void remember(const entry& e);
+	bool read_record(int64 offset, entry& e);
+
+	size_t _capacity;
+	std::list<entry> _lru;
+	std::unordered_map<uint64, std::list<entry>::iterator> _memory;
+
+	// Disk tier
+	std::unique_ptr<IFileHandle> _reader;
+	std::unique_ptr<IFileHandle> _writer;
+	std::unordered_map<uint64, int64> _disk_index;
+	int64 _disk_size;
+	bool _unflushed;
+
+	size_t _memory_hits;
+	size_t _disk_hits;
+	size_t _misses;
+
+	FCriticalSection _lock;
+};
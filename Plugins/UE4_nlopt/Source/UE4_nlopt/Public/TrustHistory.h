@@ -0,0 +1,74 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <boost/dynamic_bitset.hpp>
+#include <cstdint>
+#include <vector>
+
+// Compact (performance, trust feedback) history: one bit per outcome and one
+// byte per feedback percentage, 9 bits a site instead of 64. The number of
+// successes before every 64-site word is kept alongside, so the counts
+// before any site need at most one partial word scan.
+class trust_compact_history
+{
+public:
+	typedef uint64_t block_type;
+	static const size_t BLOCK_SITES = 64;
+
+	void push_back(int performance, int trust_feedback)
+	{
+		const size_t i = _performance.size();
+		if (i % BLOCK_SITES == 0) _ones_before_block.push_back(_ones);
+		_performance.push_back(performance != 0);
+		_ones += performance != 0;
+		_trust_feedback.push_back(static_cast<uint8_t>(trust_feedback < 0 ? 0 : (trust_feedback > 255 ? 255 : trust_feedback)));
+	}
+
+	void clear()
+	{
+		_performance.clear();
+		_trust_feedback.clear();
+		_ones_before_block.clear();
+		_ones = 0;
+	}
+
+	void reserve(size_t num_sites)
+	{
+		_performance.reserve(num_sites);
+		_trust_feedback.reserve(num_sites);
+		_ones_before_block.reserve(num_sites / BLOCK_SITES + 1);
+	}
+
+	size_t size() const { return _trust_feedback.size(); }
+	bool empty() const { return _trust_feedback.empty(); }
+
+	int performance(size_t i) const { return _performance.test(i) ? 1 : 0; }
+	int trust_feedback(size_t i) const { return _trust_feedback[i]; }
+	int last_feedback() const { return _trust_feedback.back(); }
+
+	// Successes at sites [0, i)
+	int successes_before(size_t i) const
+	{
+		if (i >= size()) return _ones;
+		const size_t block = i / BLOCK_SITES;
+		int ones = _ones_before_block[block];
+		for (size_t k = block * BLOCK_SITES; k < i; k++) ones += _performance.test(k);
+		return ones;
+	}
+	int successes() const { return _ones; }
+
+	// Heap bytes held by the history
+	size_t memory_bytes() const
+	{
+		return _performance.num_blocks() * sizeof(block_type) + _trust_feedback.capacity()
+			+ _ones_before_block.capacity() * sizeof(int);
+	}
+
+private:
+	boost::dynamic_bitset<block_type> _performance;
+	std::vector<uint8_t> _trust_feedback;
+	std::vector<int> _ones_before_block;
+	int _ones = 0;
+};
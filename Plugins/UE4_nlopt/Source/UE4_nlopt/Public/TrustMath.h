@@ -0,0 +1,88 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <boost/math/special_functions/digamma.hpp>
+#include <boost/math/special_functions/gamma.hpp>
+#include <cmath>
+
+// Special-function kernel of the trust likelihood. Every sample needs
+//     lgamma(a + b) - lgamma(a) - lgamma(b)
+// and, for the gradient, digamma(a + b) - digamma(a) and
+// digamma(a + b) - digamma(b). Once a and b are both at least
+// STIRLING_MIN, truncated Stirling series give these from three logs and
+// a few reciprocals. Below that, boost::math is used.
+//
+// Truncation error with x = min(a, b) >= STIRLING_MIN = 10 (the a + b terms
+// are smaller still):
+//   lgamma series, last term 1/(1260 x^5): |error| < 1/(1680 x^7) per term,
+//     so the log-Beta difference is off by less than 2e-10 absolute.
+//   digamma series, last term 1/(252 x^6): |error| < 1/(240 x^8) per term,
+//     so each digamma difference is off by less than 1e-10 absolute.
+// Rounding adds to that for large a and b, where the (x - 0.5) log x terms
+// are large. Measured against long double boost::math over a, b in
+// [10, 1e6]: log-Beta is off by at most 6.1e-9 absolute, 2.5e-11
+// relative, and the digamma differences by at most 4.1e-11 absolute. The
+// console command trust.CheckLogBeta asserts relative LOG_BETA_TOL and
+// absolute DIGAMMA_TOL over that range. Both are far below the
+// optimizer's 1e-4 ftol_abs.
+namespace trust_math
+{
+	const double STIRLING_MIN = 10.;
+
+	// Accuracy of log_beta_terms over [STIRLING_MIN, 1e6], see above
+	const double LOG_BETA_TOL = 1e-10;
+	const double DIGAMMA_TOL = 1e-10;
+
+	// 0.5 * log(2 pi)
+	const double HALF_LOG_2PI = 0.91893853320467274178;
+
+	// Stirling correction lgamma(x) - ((x - 0.5) log x - x + 0.5 log(2 pi))
+	inline double lgamma_correction(double r)
+	{
+		const double r2 = r * r;
+		return r * (1. / 12. - r2 * (1. / 360. - r2 * (1. / 1260.)));
+	}
+
+	// Asymptotic digamma(x) given log x and r = 1 / x
+	inline double digamma_series(double logx, double r)
+	{
+		const double r2 = r * r;
+		return logx - 0.5 * r - r2 * (1. / 12. - r2 * (1. / 120. - r2 * (1. / 252.)));
+	}
+
+	// lgamma(a + b) - lgamma(a) - lgamma(b), and when da/db are given the
+	// digamma differences digamma(a + b) - digamma(a) and digamma(a + b) - digamma(b)
+	inline double log_beta_terms(double a, double b, double* da = nullptr, double* db = nullptr)
+	{
+		const double c = a + b;
+		if (a < STIRLING_MIN || b < STIRLING_MIN)
+		{
+			if (da && db)
+			{
+				const double psi_c = boost::math::digamma(c);
+				*da = psi_c - boost::math::digamma(a);
+				*db = psi_c - boost::math::digamma(b);
+			}
+			return boost::math::lgamma(c) - boost::math::lgamma(a) - boost::math::lgamma(b);
+		}
+
+		const double loga = std::log(a);
+		const double logb = std::log(b);
+		const double logc = std::log(c);
+		const double ra = 1. / a;
+		const double rb = 1. / b;
+		const double rc = 1. / c;
+
+		if (da && db)
+		{
+			const double psi_c = digamma_series(logc, rc);
+			*da = psi_c - digamma_series(loga, ra);
+			*db = psi_c - digamma_series(logb, rb);
+		}
+
+		// The -x terms of the three expansions cancel
+		return (c - 0.5) * logc - (a - 0.5) * loga - (b - 0.5) * logb - HALF_LOG_2PI
+			+ lgamma_correction(rc) - lgamma_correction(ra) - lgamma_correction(rb);
+	}
+}
@@ -0,0 +1,244 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/ParallelFor.h"
+#include <nlopt.hpp>
+#include "TrustMath.h"
+#include "TrustHistory.h"
+#include <vector>
+
+// Parameter bounds of the trust model, x = (alpha0, beta0, ws, wf)
+const double trust_lb[4] = { 1., 1., 0.1, 0.1 };
+const double trust_ub[4] = { 200., 200., 200., 200. };
+
+// Version of the model stored in trust_fit_cache files, which are rejected
+// when it differs. Bump it when the likelihood, the bounds or the fit
+// change the parameters a history and profile give.
+const uint32 TRUST_MODEL_VERSION = 1;
+
+// Partial sums of the log-likelihood and its gradient over a run of sites
+struct trust_partial
+{
+	double logl = 0.;
+	double grad[4] = { 0., 0., 0., 0. };
+
+	trust_partial& operator+=(const trust_partial& other)
+	{
+		logl += other.logl;
+		for (int i = 0; i < 4; i++) grad[i] += other.grad[i];
+		return *this;
+	}
+};
+
+// Log-likelihood of the beta trust model and its gradient with respect to
+// x = (alpha0, beta0, ws, wf). Bound to nlopt with set_max_objective_typed<4>,
+// so the whole evaluation is visible to (and inlined into) the nlopt wrapper.
+struct trust_objective
+{
+	// Sites per chunk of the parallel reduction. This is fixed, so the
+	// chunking, and with it the rounding of the result, does not depend on
+	// the thread count.
+	static const size_t CHUNK_SITES = 2048;
+
+	const std::vector<int>* performance;
+	const std::vector<int>* trust_feedback;
+
+	// Compact history, read instead of the vectors when set
+	const trust_compact_history* history = nullptr;
+
+	// Optional evaluation cap, forces a stop on the running optimizer
+	nlopt::opt* _opt = nullptr;
+	int _max_evals = 0;
+
+	// Histories shorter than this are summed serially. The console command
+	// trust.BenchReduction prints the crossover on the running machine.
+	size_t parallel_min_sites = 4096;
+
+	double operator()(unsigned n, const double* x, double* grad) const
+	{
+		if (_opt && _max_evals > 0 && _opt->get_numevals() >= _max_evals)
+		{
+			_opt->force_stop();
+		}
+
+		const size_t num_sites = history ? history->size() : performance->size();
+		const trust_partial total = (num_sites < parallel_min_sites || num_sites <= CHUNK_SITES)
+			? accumulate(x, 0, num_sites, 0, 0, grad != nullptr)
+			: accumulate_parallel(x, num_sites, grad != nullptr);
+
+		if (grad)
+		{
+			for (unsigned i = 0; i < n; i++) grad[i] = i < 4 ? total.grad[i] : 0.;
+		}
+		return total.logl;
+	}
+
+	// Sites [begin, end), given ns successes and nf failures before begin
+	trust_partial accumulate(const double* x, size_t begin, size_t end, int ns, int nf, bool want_grad) const
+	{
+		if (history) return accumulate_sites(*history, x, begin, end, ns, nf, want_grad);
+		return accumulate_sites(vector_sites{ *performance, *trust_feedback }, x, begin, end, ns, nf, want_grad);
+	}
+
+	struct vector_sites
+	{
+		const std::vector<int>& _performance;
+		const std::vector<int>& _trust_feedback;
+		int performance(size_t i) const { return _performance[i]; }
+		int trust_feedback(size_t i) const { return _trust_feedback[i]; }
+	};
+
+	// log t and log(1 - t) of every feedback percentage, t clamped to [0.01, 0.99]
+	struct feedback_logs
+	{
+		double logt[101];
+		double log1t[101];
+
+		feedback_logs()
+		{
+			for (int f = 0; f <= 100; f++)
+			{
+				double t = (double)f / 100.;
+				if (t < 0.01) t = 0.01;
+				if (t > 0.99) t = 0.99;
+				logt[f] = (double) FMath::Loge(t);
+				log1t[f] = (double) FMath::Loge(1. - t);
+			}
+		}
+
+		static const feedback_logs& get()
+		{
+			static const feedback_logs logs;
+			return logs;
+		}
+	};
+
+	template <typename Sites>
+	trust_partial accumulate_sites(const Sites& sites, const double* x, size_t begin, size_t end, int ns, int nf, bool want_grad) const
+	{
+		const feedback_logs& logs = feedback_logs::get();
+		const double _ws = x[2];
+		const double _wf = x[3];
+		double alpha = x[0] + ns * _ws;
+		double beta = x[1] + nf * _wf;
+		trust_partial r;
+
+		for (size_t i = begin; i < end; i++)
+		{
+			int p = sites.performance(i);
+			int f = sites.trust_feedback(i);
+			if (f < 0) f = 0;
+			if (f > 100) f = 100;
+			ns += p;
+			nf += (1 - p);
+			alpha += p * _ws;
+			beta += (1 - p) * _wf;
+			double logt = logs.logt[f];
+			double log1t = logs.log1t[f];
+			double dpsi_alpha, dpsi_beta;
+			r.logl += trust_math::log_beta_terms(alpha, beta, want_grad ? &dpsi_alpha : nullptr, want_grad ? &dpsi_beta : nullptr);
+			r.logl += (alpha - 1) * logt + (beta - 1) * log1t;
+
+			if (!want_grad) continue;
+
+			r.grad[0] += (dpsi_alpha + logt);
+			r.grad[1] += (dpsi_beta + log1t);
+			r.grad[2] += (dpsi_alpha + logt) * ns;
+			r.grad[3] += (dpsi_beta + log1t) * nf;
+		}
+		return r;
+	}
+
+	// Chunks summed in parallel, then combined pairwise in a fixed order
+	trust_partial accumulate_parallel(const double* x, size_t num_sites, bool want_grad) const
+	{
+		const int32 num_chunks = static_cast<int32>((num_sites + CHUNK_SITES - 1) / CHUNK_SITES);
+
+		// Successes and failures before each chunk
+		std::vector<int> ns0(num_chunks), nf0(num_chunks);
+		int ns = 0;
+		for (int32 c = 0; c < num_chunks; c++)
+		{
+			const size_t begin = c * CHUNK_SITES;
+			const size_t end = begin + CHUNK_SITES < num_sites ? begin + CHUNK_SITES : num_sites;
+			if (history) ns = history->successes_before(begin);
+			ns0[c] = ns;
+			nf0[c] = static_cast<int>(begin) - ns;
+			if (!history)
+			{
+				for (size_t i = begin; i < end; i++) ns += (*performance)[i];
+			}
+		}
+
+		std::vector<trust_partial> parts(num_chunks);
+		ParallelFor(num_chunks, [&](int32 c)
+		{
+			const size_t begin = c * CHUNK_SITES;
+			const size_t end = begin + CHUNK_SITES < num_sites ? begin + CHUNK_SITES : num_sites;
+			parts[c] = accumulate(x, begin, end, ns0[c], nf0[c], want_grad);
+		});
+		return pairwise_sum(parts.data(), parts.size());
+	}
+
+	static trust_partial pairwise_sum(const trust_partial* parts, size_t count)
+	{
+		if (count == 1) return parts[0];
+		const size_t half = count / 2;
+		trust_partial r = pairwise_sum(parts, half);
+		r += pairwise_sum(parts + half, count - half);
+		return r;
+	}
+};
+
+// Unconstrained coordinates of the trust parameters,
+//     z = log((x - lb) / (ub - x)),  x = lb + (ub - lb) / (1 + exp(-z))
+// Near the lower bound z is log(x - lb) up to a constant, and either bound
+// is only reached as z goes to infinity, so an unbounded solver never has
+// to project onto the box. Points on or outside the bounds are moved
+// inside by a small margin first.
+inline void trust_to_unconstrained(double x[4])
+{
+	for (int k = 0; k < 4; k++)
+	{
+		const double margin = 1e-9 * (trust_ub[k] - trust_lb[k]);
+		const double v = FMath::Clamp(x[k], trust_lb[k] + margin, trust_ub[k] - margin);
+		x[k] = std::log((v - trust_lb[k]) / (trust_ub[k] - v));
+	}
+}
+
+inline void trust_from_unconstrained(double z[4])
+{
+	for (int k = 0; k < 4; k++)
+	{
+		z[k] = trust_lb[k] + (trust_ub[k] - trust_lb[k]) / (1. + std::exp(-z[k]));
+	}
+}
+
+// Any objective over x seen as a function of the unconstrained z, with the
+// gradient carried through dx/dz = (ub - lb) s (1 - s), s the logistic of z.
+// The evaluation cap stays with the wrapped objective.
+template <typename Objective>
+struct trust_reparameterized
+{
+	Objective* objective = nullptr;
+
+	double operator()(unsigned n, const double* z, double* grad) const
+	{
+		double x[4];
+		for (int k = 0; k < 4; k++) x[k] = z[k];
+		trust_from_unconstrained(x);
+
+		const double logl = (*objective)(n, x, grad);
+		if (grad)
+		{
+			for (int k = 0; k < 4; k++)
+			{
+				const double s = 1. / (1. + std::exp(-z[k]));
+				grad[k] *= (trust_ub[k] - trust_lb[k]) * s * (1. - s);
+			}
+		}
+		return logl;
+	}
+};
@@ -0,0 +1,56 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TrustObjective.h"
+#include <vector>
+
+// One participant's (performance, trust feedback) history
+struct trust_history
+{
+	std::vector<int> performance;
+	std::vector<int> trust_feedback;
+};
+
+// Pooled fit over a study. Participant j has its own x_j = (alpha0, beta0,
+// ws, wf) under a shared prior N(mu, diag(sd^2)), and
+//     sum_j logl_j(x_j) - sum_j sum_k (x_jk - mu_k)^2 / (2 sd_k^2)
+// is maximized over all x_j and mu together with L-BFGS. Each x_j only
+// couples to mu, so the gradient is one independent 4-block per
+// participant, evaluated in parallel, plus a mu block that is reduced
+// across them. Nothing grows faster than the number of participants.
+// Between rounds sd is re-estimated from the spread of the x_j.
+class UE4_NLOPT_API trust_population_fit
+{
+public:
+	trust_population_fit();
+
+	// Stopping criteria of each round and the number of rounds
+	int maxeval;
+	double ftol_rel;
+	int rounds;
+
+	// Initial prior spread, and its floor when re-estimated
+	double prior_sd[4];
+	double min_sd[4];
+
+	// Fit all histories, returns false if any round failed outright
+	bool fit(const std::vector<trust_history>& histories);
+
+	const double* population_mean() const { return _x.data() + 4 * _num_participants; }
+	const double* population_sd() const { return _sd; }
+	const double* participant(size_t j) const { return _x.data() + 4 * j; }
+	size_t num_participants() const { return _num_participants; }
+	double log_posterior() const { return _log_posterior; }
+
+	// Joint objective over x = (x_0, ..., x_{J-1}, mu), for nlopt
+	double operator()(unsigned n, const double* x, double* grad) const;
+
+private:
+	const std::vector<trust_history>* _histories;
+	size_t _num_participants;
+	std::vector<double> _x;
+	double _sd[4];
+	double _log_posterior;
+};
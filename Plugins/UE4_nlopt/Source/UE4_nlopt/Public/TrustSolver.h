@@ -0,0 +1,73 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TrustObjective.h"
+#include <vector>
+
+// Resumable projected L-BFGS for the trust model, maximizing the same
+// log-likelihood as the nlopt path within box bounds. All of the solver
+// state lives in this object and run() returns between objective
+// evaluations once its time budget is spent, so one solve can be spread
+// across several frames.
+class UE4_NLOPT_API trust_solver
+{
+public:
+	static const int DIM = 4;
+
+	trust_solver();
+
+	void set_bounds(const double* lb, const double* ub);
+	void set_stopping(int maxeval, double xtol_rel, double ftol_rel, double ftol_abs);
+
+	// Start a new solve from x0, reading the histories in place
+	void start(const double* x0, const std::vector<int>* performance, const std::vector<int>* trust_feedback);
+	void start(const double* x0, const trust_compact_history* history);
+
+	// Continue for about budget_us microseconds (at least one step),
+	// returns true once the solve has finished
+	bool run(double budget_us);
+
+	bool finished() const { return _phase == phase::done; }
+	int get_numevals() const { return _numevals; }
+
+	// Best point found so far and its log-likelihood
+	const double* best_x() const { return _best_x; }
+	double best_logl() const { return -_best_f; }
+
+private:
+	enum class phase { idle, first_eval, trial, done };
+
+	static const int MEM = 5;
+	static const int MAX_TRIES = 10;
+
+	void restart(const double* x0);
+	void step();
+	void next_direction();
+	double evaluate(const double* x, double* grad);
+	void project(double* x) const;
+	bool is_fixed(int i) const;
+
+	trust_objective _objective;
+
+	// Bounds and stopping criteria
+	double _lb[DIM], _ub[DIM];
+	int _maxeval;
+	double _xtol_rel, _ftol_rel, _ftol_abs;
+
+	// Current iterate, minimizing f = -logl
+	phase _phase;
+	int _numevals;
+	double _x[DIM], _g[DIM], _f;
+
+	// Backtracking line search along _d
+	double _d[DIM], _step;
+	int _tries;
+
+	double _best_x[DIM], _best_f;
+
+	// L-BFGS memory, a ring of the last MEM (s, y) pairs
+	double _s[MEM][DIM], _y[MEM][DIM], _rho[MEM];
+	int _mem_count, _mem_head;
+};
@@ -0,0 +1,63 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TrustFit.h"
+#include "TrustPopulation.h"
+#include <vector>
+
+// Ground truth and shape of a synthetic study drawn from the trust model
+// itself: at site i the outcome is a success with success_rate, and the
+// feedback is 100 t rounded, t ~ Beta(alpha0 + ns ws, beta0 + nf wf) over
+// the successes and failures up to and including site i.
+struct trust_synthetic_config
+{
+	// (alpha0, beta0, ws, wf)
+	double x[4] = { 20., 10., 2., 4. };
+
+	// Participants draw their own parameters x exp(spread N(0, 1)) about x,
+	// clamped to the trust bounds. 0 gives everyone x.
+	double spread = 0.;
+
+	int num_participants = 100;
+
+	// History lengths are uniform in [min_sites, max_sites]
+	int min_sites = 40;
+	int max_sites = 40;
+
+	double success_rate = 0.7;
+	uint32 seed = 1;
+};
+
+// Beta(a, b) draw from gamma draws (Marsaglia and Tsang), on the caller's
+// stream so the sequence only depends on its seed
+UE4_NLOPT_API double trust_sample_beta(FRandomStream& rng, double a, double b);
+
+// Participant j of the study: its true parameters and history. Participant
+// j draws from its own stream seeded by (seed, j), so any participant can
+// be generated alone and the study does not depend on the thread count.
+UE4_NLOPT_API void trust_synthesize(const trust_synthetic_config& config, int j, double x[4], trust_history& history);
+
+// Every participant, generated in parallel. truth, if given, receives the
+// parameters of participant j at 4 j.
+UE4_NLOPT_API void trust_synthesize_study(const trust_synthetic_config& config, std::vector<trust_history>& histories,
+										  std::vector<double>* truth = nullptr);
+
+// How well fits recover the ground truth of a synthetic study
+struct trust_recovery
+{
+	// Mean of estimate - truth, and root mean square of it, per parameter
+	double bias[4] = { 0., 0., 0., 0. };
+	double rmse[4] = { 0., 0., 0., 0. };
+
+	// Mean absolute error of the fitted trust trajectory against the true one
+	double trajectory_mae = 0.;
+
+	double mean_evals = 0.;
+	double seconds = 0.;
+};
+
+// Generate the study, fit every participant with profile in parallel from
+// the first-feedback initial guess, and compare with the truth
+UE4_NLOPT_API trust_recovery trust_check_recovery(const trust_synthetic_config& config, const trust_profile& profile);
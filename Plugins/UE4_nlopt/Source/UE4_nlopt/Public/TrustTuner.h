@@ -0,0 +1,77 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TrustFit.h"
+#include "TrustPopulation.h"
+#include <vector>
+
+// Replay result of one candidate profile
+struct trust_tuning_point
+{
+	trust_profile profile;
+	// Mean and worst wall time of one online update, in microseconds
+	double latency_us = 0.;
+	double max_latency_us = 0.;
+	// RMS difference of the trust estimate from the reference fits
+	double deviation = 0.;
+	double mean_evals = 0.;
+	// Passed the screening and was timed, latency is 0 otherwise
+	bool timed = false;
+	bool pareto = false;
+};
+
+// Grid search over solver profiles. Each history is replayed update by
+// update, as AOptimizer::UpdateParameters runs it online: one configured
+// optimizer per participant, warm-started from its own last estimate.
+// Each update's trust estimate is compared with that of a converged fit of
+// the same prefix.
+//
+// The search runs in two passes. The first replays every grid point in
+// parallel, untimed, for its deviation and evaluation count. Within one
+// algorithm and solve form the cost of an update is close to proportional
+// to its evaluations, so only the points no other point of the same
+// algorithm and form beats on both are kept. The second pass times those
+// one at a time on the calling thread, so the latencies are not disturbed
+// by each other, and the Pareto front and recommendation are taken over
+// them.
+class UE4_NLOPT_API trust_profile_tuner
+{
+public:
+	trust_profile_tuner();
+
+	// Grid axes, every combination is replayed
+	std::vector<nlopt::algorithm> algorithms;
+	std::vector<int> maxevals;
+	std::vector<int> eval_caps;
+	std::vector<double> xtols;
+	// ftol_rel and ftol_abs values
+	std::vector<double> ftols;
+	std::vector<double> abs_ftols;
+	// Bounded and / or reparameterized solves. Bounded only by default,
+	// add true once trust.BenchReparam shows a gain on the target data.
+	std::vector<bool> reparameterizations;
+
+	// Timed replays per screened point, the fastest one is kept
+	int timing_runs;
+
+	// Largest RMS trust deviation the recommended profile may have
+	double max_deviation;
+
+	// Returns false if there are no updates to replay
+	bool run(const std::vector<trust_history>& histories);
+
+	const std::vector<trust_tuning_point>& points() const { return _points; }
+
+	// Pareto-optimal timed points by increasing latency
+	std::vector<trust_tuning_point> pareto_front() const;
+
+	// Fastest front point within max_deviation, else the most accurate one.
+	// Only valid after run() returned true.
+	const trust_tuning_point& recommended() const { return _points[_recommended]; }
+
+private:
+	std::vector<trust_tuning_point> _points;
+	size_t _recommended;
+};